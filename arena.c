@@ -0,0 +1,391 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// #define UNIT_TEST
+// #define DEBUG_ON
+#include "arena.h"
+#include "debug.h"
+
+#define DEFAULT_BLOCK_SIZE (64 * 1024)
+#define HUGE_BLOCK_SIZE (2 * 1024 * 1024)
+#define ALIGNMENT 16
+#define ALIGN(size, alignment) (((size) + (alignment)-1) & ~((size_t)(alignment)-1))
+// larger requests would wrap the header, alignment or huge page rounding
+#define MAX_BLOCK_SIZE (SIZE_MAX - sizeof(arena_block_s) - HUGE_BLOCK_SIZE)
+
+arena_s *arena_init(arena_s *arena, size_t block_size, size_t limit) {
+    if (arena == NULL) {
+        return NULL;
+    }
+    memset(arena, 0, sizeof(arena_s));
+
+    arena->block_size = block_size == 0 ? DEFAULT_BLOCK_SIZE : block_size;
+    arena->limit = limit;
+    return arena;
+}
+
+// bytes a block for size usable bytes really takes, mapped blocks are rounded to whole huge pages
+size_t arena_block_total(size_t size) {
+    size_t total = sizeof(arena_block_s) + size;
+#ifdef __linux__
+    if (total >= HUGE_BLOCK_SIZE) {
+        return ALIGN(total, HUGE_BLOCK_SIZE);
+    }
+#endif
+    return total;
+}
+
+arena_block_s *arena_block_new(size_t size) {
+    arena_block_s *block;
+    if (size > MAX_BLOCK_SIZE) {
+        return NULL;
+    }
+    size_t total = arena_block_total(size);
+
+#ifdef __linux__
+    if (total >= HUGE_BLOCK_SIZE) {
+        block = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (block == MAP_FAILED) {
+            block = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (block == MAP_FAILED) {
+                return NULL;
+            }
+            madvise(block, total, MADV_HUGEPAGE);
+        }
+        block->mapped = total;
+        block->size = total - sizeof(arena_block_s);
+        block->used = 0;
+        block->next = NULL;
+        return block;
+    }
+#endif
+
+    if ((block = malloc(total)) == NULL) {
+        return NULL;
+    }
+    block->mapped = 0;
+    block->size = size;
+    block->used = 0;
+    block->next = NULL;
+    return block;
+}
+
+void arena_block_destroy(arena_block_s *block) {
+#ifdef __linux__
+    if (block->mapped) {
+        munmap(block, block->mapped);
+        return;
+    }
+#endif
+    free(block);
+}
+
+size_t arena_block_footprint(arena_block_s *block) {
+    return block->mapped ? block->mapped : sizeof(arena_block_s) + block->size;
+}
+
+void arena_destroy_list(arena_s *arena, arena_block_s *block) {
+    while (block != NULL) {
+        arena_block_s *next = block->next;
+        arena->bytes -= arena_block_footprint(block);
+        arena_block_destroy(block);
+        block = next;
+    }
+}
+
+void arena_free(arena_s *arena) {
+    if (arena != NULL) {
+        arena_destroy_list(arena, arena->blocks);
+        arena->blocks = NULL;
+        arena_destroy_list(arena, arena->free_blocks);
+        arena->free_blocks = NULL;
+    }
+}
+
+void arena_trim(arena_s *arena) {
+    arena_destroy_list(arena, arena->free_blocks);
+    arena->free_blocks = NULL;
+}
+
+void arena_reset(arena_s *arena) {
+    while (arena->blocks != NULL) {
+        arena_block_s *block = arena->blocks;
+        arena->blocks = block->next;
+        arena_block_release(arena, block);
+    }
+}
+
+arena_block_s *arena_block_get(arena_s *arena, size_t size) {
+    arena_block_s *block;
+    if (arena == NULL) {
+        return arena_block_new(size);
+    }
+
+    for (arena_block_s **prev = &arena->free_blocks; *prev != NULL; prev = &(*prev)->next) {
+        if ((*prev)->size >= size) {
+            block = *prev;
+            *prev = block->next;
+            block->next = NULL;
+            block->used = 0;
+            arena->block_recycles++;
+            return block;
+        }
+    }
+
+    if (size > MAX_BLOCK_SIZE) {
+        return NULL;
+    }
+    size_t total = arena_block_total(size);
+    if (arena->limit != 0 && total > arena->limit - arena->bytes) {
+        arena_trim(arena);
+        if (total > arena->limit - arena->bytes) {
+            return NULL;
+        }
+    }
+
+    if ((block = arena_block_new(size)) == NULL) {
+        return NULL;
+    }
+    arena->block_allocations++;
+    arena->bytes += arena_block_footprint(block);
+    if (arena->bytes > arena->peak_bytes) {
+        arena->peak_bytes = arena->bytes;
+    }
+    return block;
+}
+
+void arena_block_release(arena_s *arena, arena_block_s *block) {
+    if (block == NULL) {
+        return;
+    }
+    if (arena == NULL) {
+        arena_block_destroy(block);
+        return;
+    }
+    block->next = arena->free_blocks;
+    arena->free_blocks = block;
+}
+
+void *arena_alloc(arena_s *arena, size_t size) {
+    if (size > MAX_BLOCK_SIZE) {
+        return NULL;
+    }
+    size = ALIGN(size, ALIGNMENT);
+    arena_block_s *block = arena->blocks;
+
+    if (block == NULL || block->size - block->used < size) {
+        if ((block = arena_block_get(arena, size > arena->block_size ? size : arena->block_size)) == NULL) {
+            return NULL;
+        }
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    void *ptr = &block->data[block->used];
+    block->used += size;
+    arena->allocations++;
+    return ptr;
+}
+
+void *arena_memdup(arena_s *arena, const void *src, size_t size) {
+    void *dst = arena_alloc(arena, size);
+    if (dst != NULL) {
+        memcpy(dst, src, size);
+    }
+    return dst;
+}
+
+void arena_print_stats(arena_s *arena, FILE *fp) {
+    fprintf(fp, "allocations       %zu\n", arena->allocations);
+    fprintf(fp, "block allocations %zu\n", arena->block_allocations);
+    fprintf(fp, "block recycles    %zu\n", arena->block_recycles);
+    fprintf(fp, "bytes             %zu\n", arena->bytes);
+    fprintf(fp, "peak bytes        %zu\n", arena->peak_bytes);
+}
+
+#ifdef UNIT_TEST
+#include "unit_test.h"
+
+void test_init_free() {
+    arena_s arena;
+    arena_s *ret = arena_init(&arena, 0, 0);
+
+    ut_assert(ret == &arena);
+    ut_assert(ut_number_equals(DEFAULT_BLOCK_SIZE, arena.block_size));
+    ut_assert(ut_number_equals(0, arena.limit));
+    ut_assert(ut_is_NULL(arena.blocks));
+
+    arena_free(&arena);
+    ut_assert(ut_number_equals(0, arena.bytes));
+}
+
+void test_alloc_bump() {
+    arena_s arena;
+    arena_init(&arena, 128, 0);
+
+    uint8_t *first = arena_alloc(&arena, 10);
+    uint8_t *second = arena_alloc(&arena, 20);
+    ut_assert(ut_is_not_NULL(first));
+    ut_assert(second == first + ALIGN(10, ALIGNMENT));
+    ut_assert(((uintptr_t)second % ALIGNMENT) == 0);
+    ut_assert(ut_number_equals(2, arena.allocations));
+    ut_assert(ut_number_equals(1, arena.block_allocations));
+
+    uint8_t *third = arena_alloc(&arena, 100);
+    ut_assert(ut_is_not_NULL(third));
+    ut_assert(ut_number_equals(2, arena.block_allocations));
+
+    uint8_t *large = arena_alloc(&arena, 1000);
+    ut_assert(ut_is_not_NULL(large));
+    ut_assert(ut_number_equals(ALIGN(1000, ALIGNMENT), arena.blocks->size));
+
+    arena_free(&arena);
+    ut_assert(ut_number_equals(0, arena.bytes));
+}
+
+void test_memdup() {
+    arena_s arena;
+    arena_init(&arena, 0, 0);
+
+    char *copy = arena_memdup(&arena, "test", 5);
+    ut_assert(ut_str_equals("test", copy));
+
+    arena_free(&arena);
+}
+
+void test_reset_recycles_blocks() {
+    arena_s arena;
+    arena_init(&arena, 64, 0);
+
+    for (int i = 0; i < 10; i++) {
+        arena_alloc(&arena, 64);
+    }
+    ut_assert(ut_number_equals(10, arena.block_allocations));
+    size_t peak = arena.peak_bytes;
+
+    arena_reset(&arena);
+    ut_assert(ut_is_NULL(arena.blocks));
+
+    for (int i = 0; i < 10; i++) {
+        arena_alloc(&arena, 64);
+    }
+    ut_assert(ut_number_equals(10, arena.block_allocations));
+    ut_assert(ut_number_equals(10, arena.block_recycles));
+    ut_assert(ut_number_equals(peak, arena.peak_bytes));
+
+    arena_free(&arena);
+}
+
+void test_block_get_release() {
+    arena_s arena;
+    arena_init(&arena, 0, 0);
+
+    arena_block_s *small = arena_block_get(&arena, 100);
+    ut_assert(ut_is_not_NULL(small));
+    arena_block_release(&arena, small);
+
+    arena_block_s *larger = arena_block_get(&arena, 200);
+    ut_assert(larger != small);
+
+    arena_block_s *recycled = arena_block_get(&arena, 50);
+    ut_assert(recycled == small);
+
+    arena_block_release(&arena, larger);
+    arena_block_release(&arena, recycled);
+    arena_free(&arena);
+    ut_assert(ut_number_equals(0, arena.bytes));
+}
+
+void test_block_without_arena() {
+    arena_block_s *block = arena_block_get(NULL, 100);
+    ut_assert(ut_is_not_NULL(block));
+    ut_assert(ut_number_equals(100, block->size));
+    arena_block_release(NULL, block);
+}
+
+void test_huge_block() {
+    arena_s arena;
+    arena_init(&arena, 0, 0);
+
+    arena_block_s *block = arena_block_get(&arena, HUGE_BLOCK_SIZE);
+    ut_assert(ut_is_not_NULL(block));
+    ut_assert(block->size >= HUGE_BLOCK_SIZE);
+    memset(block->data, 1, block->size);
+
+    arena_block_release(&arena, block);
+    arena_free(&arena);
+    ut_assert(ut_number_equals(0, arena.bytes));
+}
+
+void test_limit() {
+    arena_s arena;
+    arena_init(&arena, 1024, 3000);
+
+    ut_assert(ut_is_not_NULL(arena_alloc(&arena, 1024)));
+    ut_assert(ut_is_not_NULL(arena_alloc(&arena, 1024)));
+    ut_assert(ut_is_NULL(arena_alloc(&arena, 1024)));
+
+    arena_block_s *block = arena_block_get(&arena, 10);
+    ut_assert(ut_is_not_NULL(block));
+    arena_block_release(&arena, block);
+
+    arena_reset(&arena);
+    ut_assert(ut_is_not_NULL(arena_alloc(&arena, 2000)));
+    ut_assert(arena.bytes <= 3000);
+
+    arena_free(&arena);
+}
+
+void test_limit_huge_block() {
+    arena_s arena;
+    arena_init(&arena, 0, 3 * 1024 * 1024);
+
+    ut_assert(ut_is_NULL(arena_alloc(&arena, 2200 * 1024)));
+    ut_assert(ut_number_equals(0, arena.bytes));
+
+    ut_assert(ut_is_not_NULL(arena_alloc(&arena, 1024 * 1024)));
+    ut_assert(arena.bytes <= arena.limit);
+    ut_assert(arena.peak_bytes <= arena.limit);
+
+    arena_free(&arena);
+}
+
+void test_huge_size() {
+    arena_s arena;
+    arena_init(&arena, 0, 0);
+
+    ut_assert(ut_is_NULL(arena_alloc(&arena, SIZE_MAX)));
+    ut_assert(ut_is_NULL(arena_alloc(&arena, SIZE_MAX - sizeof(arena_block_s))));
+    ut_assert(ut_is_NULL(arena_alloc(&arena, MAX_BLOCK_SIZE + 1)));
+    ut_assert(ut_is_NULL(arena_block_get(&arena, SIZE_MAX - 8)));
+    ut_assert(ut_is_NULL(arena_block_get(NULL, SIZE_MAX)));
+    ut_assert(ut_number_equals(0, arena.bytes));
+
+    arena_init(&arena, 0, 1024 * 1024);
+    ut_assert(ut_is_NULL(arena_alloc(&arena, SIZE_MAX - 1)));
+    ut_assert(ut_is_not_NULL(arena_alloc(&arena, 1024)));
+
+    arena_free(&arena);
+}
+
+int main(int argc, char **argv) {
+    ut_run(test_init_free);
+    ut_run(test_alloc_bump);
+    ut_run(test_memdup);
+    ut_run(test_reset_recycles_blocks);
+    ut_run(test_block_get_release);
+    ut_run(test_block_without_arena);
+    ut_run(test_huge_block);
+    ut_run(test_limit);
+    ut_run(test_limit_huge_block);
+    ut_run(test_huge_size);
+    return ut_end();
+}
+
+#endif  // UNIT_TEST
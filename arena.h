@@ -0,0 +1,40 @@
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct arena_block_s {
+    struct arena_block_s *next;
+    size_t size;
+    size_t used;
+    size_t mapped;
+    uint8_t data[];
+} arena_block_s;
+
+typedef struct {
+    size_t block_size;
+    size_t limit;
+
+    arena_block_s *blocks;
+    arena_block_s *free_blocks;
+
+    size_t allocations;
+    size_t block_allocations;
+    size_t block_recycles;
+    size_t bytes;
+    size_t peak_bytes;
+} arena_s;
+
+arena_s *arena_init(arena_s *arena, size_t block_size, size_t limit);
+void arena_free(arena_s *arena);
+void arena_reset(arena_s *arena);
+void arena_trim(arena_s *arena);
+void *arena_alloc(arena_s *arena, size_t size);
+void *arena_memdup(arena_s *arena, const void *src, size_t size);
+
+arena_block_s *arena_block_get(arena_s *arena, size_t size);
+void arena_block_release(arena_s *arena, arena_block_s *block);
+
+void arena_print_stats(arena_s *arena, FILE *fp);
+
+#endif  // ARENA_INCLUDED
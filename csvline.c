@@ -3,30 +3,33 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define UNIT_TEST
+// #define UNIT_TEST
 // #define DEBUG_ON
 #include "csvline.h"
 #include "debug.h"
 
 #define DEFAULT_READ_SIZE 1024
 #define DEFAULT_FIELD_SIZE 128
+#define DEFAULT_BATCH_ROWS_SIZE 1024
 
-csv_line_s *csv_line_init(csv_line_s *csv, char separator, size_t read_size, size_t fields_size) {
+csv_line_s *csv_line_init(csv_line_s *csv, arena_s *arena, char separator, size_t read_size, size_t fields_size) {
     if (csv == NULL) {
         return NULL;
     }
     memset(csv, 0, sizeof(csv_line_s));
 
+    csv->arena = arena;
     csv->read_size = read_size == 0 ? DEFAULT_READ_SIZE : read_size;
-    csv->size = csv->read_size;
     csv->separator = separator;
-    if ((csv->buffer = malloc(csv->size + 1)) == NULL) {
+    if ((csv->block = arena_block_get(arena, csv->read_size + 1)) == NULL) {
         return NULL;
     }
+    csv->buffer = csv->block->data;
+    csv->size = csv->block->size - 1;
 
     csv->fields_size = fields_size == 0 ? DEFAULT_FIELD_SIZE : fields_size;
     if ((csv->fields = malloc(csv->fields_size * sizeof(size_t))) == NULL) {
-        free(csv->buffer);
+        arena_block_release(arena, csv->block);
         return NULL;
     }
     return csv;
@@ -34,8 +37,9 @@ csv_line_s *csv_line_init(csv_line_s *csv, char separator, size_t read_size, siz
 
 void csv_line_free(csv_line_s *csv) {
     if (csv != NULL) {
-        if (csv->buffer != NULL) {
-            free(csv->buffer);
+        if (csv->block != NULL) {
+            arena_block_release(csv->arena, csv->block);
+            csv->block = NULL;
             csv->buffer = NULL;
         }
         if (csv->fields != NULL) {
@@ -52,32 +56,46 @@ size_t csv_line_fill_buffer(csv_line_s *csv) {
 
     size_t space = csv->size - csv->end;
     if (space < csv->read_size) {
-        if (csv->start > 0) {
-            size_t len = csv->end - csv->start;
-            memcpy(csv->buffer, &csv->buffer[csv->start], len);
-            csv->start = 0;
-            csv->end = len;
-            space = csv->size - csv->end;
-        }
-        if (space < csv->read_size) {
-            csv->size += csv->read_size;
-            csv->buffer = realloc(csv->buffer, csv->size + 1);  // todo: check alloc
+        size_t len = csv->end - csv->start;
+        if (csv->size - len < csv->read_size) {
+            size_t size = csv->size * 2;
+            while (size - len < csv->read_size) {
+                size *= 2;
+            }
+            arena_block_s *block = arena_block_get(csv->arena, size + 1);
+            if (block == NULL) {
+                csv->out_of_memory = 1;
+                return 0;
+            }
+            memcpy(block->data, &csv->buffer[csv->start], len);
+            arena_block_release(csv->arena, csv->block);
+            csv->block = block;
+            csv->buffer = block->data;
+            csv->size = block->size - 1;
+        } else if (csv->start > 0) {
+            memmove(csv->buffer, &csv->buffer[csv->start], len);
         }
+        csv->start = 0;
+        csv->end = len;
     }
     size_t read = fread(&csv->buffer[csv->end], 1, csv->read_size, csv->file);
     csv->end += read;
     return read;
 }
 
-void csv_line_open_file(csv_line_s *csv, char *file_name) {
-    csv->file_name = file_name;
-    csv->file = fopen(file_name, "rb");  // todo check file open
+void csv_line_open(csv_line_s *csv, FILE *file) {
+    csv->file = file;
     csv->start = 0;
     csv->next = 0;
     csv->end = 0;
     csv_line_fill_buffer(csv);
 }
 
+void csv_line_open_file(csv_line_s *csv, char *file_name) {
+    csv->file_name = file_name;
+    csv_line_open(csv, fopen(file_name, "rb"));  // todo check file open
+}
+
 void csv_line_close_file(csv_line_s *csv) {
     if (csv->file != NULL) {
         fclose(csv->file);
@@ -93,40 +111,68 @@ void csv_line_close_file(csv_line_s *csv) {
         }                                  \
     }
 
-size_t csv_line_read_line(csv_line_s *csv) {
-    size_t pos = 0;
+int csv_line_grow_fields(csv_line_s *csv) {
+    size_t *fields = realloc(csv->fields, csv->fields_size * 2 * sizeof(size_t));
+    if (fields == NULL) {
+        csv->out_of_memory = 1;
+        return 0;
+    }
+    csv->fields = fields;
+    csv->fields_size *= 2;
+    return 1;
+}
+
+#define ADD_FIELD                                                                 \
+    if (csv->fields_count + 2 > csv->fields_size && !csv_line_grow_fields(csv)) { \
+        csv->fields_count = 0;                                                    \
+        return 0;                                                                 \
+    }                                                                             \
+    csv->fields[csv->fields_count++] = pos;
+
+#define END_FIELD \
+    CURRENT = 0;  \
+    pos++;        \
+    csv->fields[csv->fields_count] = pos;
+
+// parses the line at csv->next, field offsets are relative to csv->start
+size_t csv_line_parse_line(csv_line_s *csv) {
+    size_t pos = csv->next - csv->start;
     csv->fields_count = 0;
-    csv->start = csv->next;
     char separator = csv->separator;
 
     while (1) {
-        FILL_BUFFER_IF_NEEDED_BREAK_ON_EOF
-        csv->fields[csv->fields_count++] = pos;
+        if (CURRENT_POS == csv->end && !csv_line_fill_buffer(csv)) {
+            if (csv->fields_count > 0) {  // separator right before EOF ends with an empty field
+                csv->next = CURRENT_POS;
+                ADD_FIELD
+                END_FIELD
+                return csv->fields_count;
+            }
+            break;
+        }
+        ADD_FIELD
         while (CURRENT_POS < csv->end && CURRENT != separator && CURRENT != '\r' && CURRENT != '\n') {
             if (CURRENT_POS + 1 == csv->end) {
                 if (!csv_line_fill_buffer(csv)) {
                     pos++;
-                    CURRENT = 0;
+                    csv->next = CURRENT_POS;
+                    END_FIELD
                     return csv->fields_count;
                 }
             }
             pos++;
         }
         if (CURRENT == separator) {
-            CURRENT = 0;
-            pos++;
+            END_FIELD
         } else if (CURRENT == '\r') {
-            CURRENT = 0;
-            pos++;
+            END_FIELD
             FILL_BUFFER_IF_NEEDED_BREAK_ON_EOF
             if (CURRENT == '\n') {
                 pos++;
             }
-            csv->next = CURRENT_POS;
             break;
         } else {
-            CURRENT = 0;
-            pos++;
+            END_FIELD
             break;
         }
     }
@@ -134,12 +180,113 @@ size_t csv_line_read_line(csv_line_s *csv) {
     return csv->fields_count;
 }
 
+size_t csv_line_read_line(csv_line_s *csv) {
+    if (csv->out_of_memory) {
+        return 0;
+    }
+    csv->start = csv->next;
+    csv_line_parse_line(csv);
+    if (csv->out_of_memory) {
+        csv->fields_count = 0;
+    }
+    return csv->fields_count;
+}
+
+csv_line_batch_s *csv_line_batch_init(csv_line_batch_s *batch, size_t rows_size, size_t fields_size) {
+    if (batch == NULL) {
+        return NULL;
+    }
+    memset(batch, 0, sizeof(csv_line_batch_s));
+
+    batch->rows_size = rows_size == 0 ? DEFAULT_BATCH_ROWS_SIZE : rows_size;
+    if ((batch->rows = malloc((batch->rows_size + 1) * sizeof(size_t))) == NULL) {
+        return NULL;
+    }
+
+    batch->fields_size = fields_size == 0 ? batch->rows_size * DEFAULT_FIELD_SIZE : fields_size;
+    batch->offsets = malloc(batch->fields_size * sizeof(size_t));
+    batch->lengths = malloc(batch->fields_size * sizeof(size_t));
+    if (batch->offsets == NULL || batch->lengths == NULL) {
+        csv_line_batch_free(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+void csv_line_batch_free(csv_line_batch_s *batch) {
+    if (batch != NULL) {
+        if (batch->rows != NULL) {
+            free(batch->rows);
+            batch->rows = NULL;
+        }
+        if (batch->offsets != NULL) {
+            free(batch->offsets);
+            batch->offsets = NULL;
+        }
+        if (batch->lengths != NULL) {
+            free(batch->lengths);
+            batch->lengths = NULL;
+        }
+    }
+}
+
+int csv_line_batch_grow_fields(csv_line_batch_s *batch, size_t fields_count) {
+    size_t fields_size = batch->fields_size;
+    while (fields_count > fields_size) {
+        fields_size *= 2;
+    }
+    size_t *offsets = realloc(batch->offsets, fields_size * sizeof(size_t));
+    if (offsets == NULL) {
+        return 0;
+    }
+    batch->offsets = offsets;
+    size_t *lengths = realloc(batch->lengths, fields_size * sizeof(size_t));
+    if (lengths == NULL) {
+        return 0;
+    }
+    batch->lengths = lengths;
+    batch->fields_size = fields_size;
+    return 1;
+}
+
+// reads up to rows_size lines, the fields of row r are rows[r] .. rows[r + 1] - 1
+// data stays valid until the next read on csv, on out of memory no rows are returned
+size_t csv_line_read_batch(csv_line_s *csv, csv_line_batch_s *batch) {
+    batch->rows_count = 0;
+    batch->fields_count = 0;
+    batch->rows[0] = 0;
+    if (csv->out_of_memory) {
+        return 0;
+    }
+    csv->start = csv->next;
+
+    while (batch->rows_count < batch->rows_size && csv_line_parse_line(csv) && !csv->out_of_memory) {
+        if (batch->fields_count + csv->fields_count > batch->fields_size &&
+            !csv_line_batch_grow_fields(batch, batch->fields_count + csv->fields_count)) {
+            csv->out_of_memory = 1;
+            break;
+        }
+        for (size_t i = 0; i < csv->fields_count; i++) {
+            batch->offsets[batch->fields_count] = csv->fields[i];
+            batch->lengths[batch->fields_count++] = csv->fields[i + 1] - csv->fields[i] - 1;
+        }
+        batch->rows[++batch->rows_count] = batch->fields_count;
+    }
+    if (csv->out_of_memory) {
+        batch->rows_count = 0;
+        batch->fields_count = 0;
+        return 0;
+    }
+    batch->data = &csv->buffer[csv->start];
+    return batch->rows_count;
+}
+
 #ifdef UNIT_TEST
 #include "unit_test.h"
 
 void test_init_free() {
     csv_line_s csv;
-    csv_line_s *ret = csv_line_init(&csv, ',', 10, 2);
+    csv_line_s *ret = csv_line_init(&csv, NULL, ',', 10, 2);
 
     ut_assert(ret == &csv);
 
@@ -157,7 +304,7 @@ void test_init_free() {
 
 void test_init_defaults() {
     csv_line_s csv;
-    csv_line_s *ret = csv_line_init(&csv, ',', 0, 0);
+    csv_line_s *ret = csv_line_init(&csv, NULL, ',', 0, 0);
 
     ut_assert(ret == &csv);
 
@@ -185,7 +332,7 @@ void test_fill_buffer() {
     create_test_file(TEST_FILE, TEST_DATA);
 
     csv_line_s csv;
-    csv_line_init(&csv, ',', 2, 0);
+    csv_line_init(&csv, NULL, ',', 2, 0);
     csv_line_open_file(&csv, TEST_FILE);
 
     while (csv_line_fill_buffer(&csv));
@@ -207,13 +354,13 @@ void test_fill_buffer_keep_data() {
     create_test_file(TEST_FILE, TEST_DATA);
 
     csv_line_s csv;
-    csv_line_init(&csv, ',', 10, 0);
+    csv_line_init(&csv, NULL, ',', 10, 0);
 
     csv.file = fopen(TEST_FILE, "rb");
     ut_assert(ut_is_not_NULL(csv.file));
 
     csv.start = 5;
-    strcat(&csv.buffer[csv.start], "This ");
+    memcpy(&csv.buffer[csv.start], "This ", 5);
     csv.end = 10;
 
     while (csv_line_fill_buffer(&csv));
@@ -240,11 +387,14 @@ void test_read_line_till_eof() {
     create_test_file(TEST_FILE, TEST_DATA);
 
     csv_line_s csv;
-    csv_line_init(&csv, ',', 20, 5);
+    csv_line_init(&csv, NULL, ',', 20, 5);
     csv_line_open_file(&csv, TEST_FILE);
     csv_line_read_line(&csv);
 
     ASSERT_COLUMNS_EQUAL(3, EXPECTED_COLUMNS);
+
+    csv_line_close_file(&csv);
+    csv_line_free(&csv);
 }
 
 char *SIMPLE_COLUMNS[][3] = {
@@ -256,7 +406,7 @@ size_t READ_SIZE[] = {1, 2, 3, 5, 8, 13, 21, 1024, 0};
 assert_file_matches_simple_columns(char *file_name, char separator, size_t read_size) {
     printf("\n    ... with read_size = %d", read_size);
     csv_line_s csv;
-    csv_line_init(&csv, separator, read_size, 5);
+    csv_line_init(&csv, NULL, separator, read_size, 5);
     csv_line_open_file(&csv, file_name);
 
     csv_line_read_line(&csv);
@@ -302,6 +452,29 @@ void test_read_line_cr_lf() {
     }
 }
 
+void test_read_line_trailing_separator() {
+    char *TEST_FILE = "test/test_read_line_trailing_separator.csv";
+    char *TEST_DATA = "ONE,\n1,";
+    char *EXPECTED_COLUMNS[] = {"ONE", ""};
+    char *EXPECTED_COLUMNS_EOF[] = {"1", ""};
+    create_test_file(TEST_FILE, TEST_DATA);
+
+    for (int i = 0; READ_SIZE[i] != 0; i++) {
+        csv_line_s csv;
+        csv_line_init(&csv, NULL, ',', READ_SIZE[i], 1);
+        csv_line_open_file(&csv, TEST_FILE);
+
+        csv_line_read_line(&csv);
+        ASSERT_COLUMNS_EQUAL(2, EXPECTED_COLUMNS);
+        csv_line_read_line(&csv);
+        ASSERT_COLUMNS_EQUAL(2, EXPECTED_COLUMNS_EOF);
+        ut_assert(ut_number_equals(0, csv_line_read_line(&csv)));
+
+        csv_line_close_file(&csv);
+        csv_line_free(&csv);
+    }
+}
+
 void test_read_line_semicolon() {
     char *TEST_FILE = "test/test_read_line_cr.csv";
     char *TEST_DATA = "ONE;TWO;THREE\n1;2;3\n";
@@ -310,6 +483,150 @@ void test_read_line_semicolon() {
     assert_file_matches_simple_columns(TEST_FILE, ';', 1024);
 }
 
+char *BATCH_COLUMNS[][3] = {
+    {"ONE", "TWO", "THREE"},
+    {"1", "2", "3"},
+    {"", "", ""},
+    {"a", "bb", "ccc"},
+    {"4", "5", "6"},
+};
+
+#define ASSERT_BATCH_ROW_EQUALS(row, expected)                                    \
+    ut_assert(ut_number_equals(3, batch.rows[row + 1] - batch.rows[row]));        \
+    for (int i = 0; i < 3; i++) {                                                 \
+        size_t field = batch.rows[row] + i;                                       \
+        ut_assert(ut_str_equals(expected[i], &batch.data[batch.offsets[field]])); \
+        ut_assert(ut_number_equals(strlen(expected[i]), batch.lengths[field]));   \
+    }
+
+void assert_file_matches_batch_columns(char *file_name, size_t read_size, size_t rows_size) {
+    printf("\n    ... with read_size = %zu, rows_size = %zu", read_size, rows_size);
+    csv_line_s csv;
+    csv_line_init(&csv, NULL, ',', read_size, 2);
+    csv_line_open_file(&csv, file_name);
+
+    csv_line_batch_s batch;
+    csv_line_batch_init(&batch, rows_size, 1);
+
+    size_t row = 0;
+    size_t count;
+    while ((count = csv_line_read_batch(&csv, &batch)) > 0) {
+        ut_assert(count <= rows_size);
+        for (size_t r = 0; r < count; r++) {
+            ASSERT_BATCH_ROW_EQUALS(r, BATCH_COLUMNS[row]);
+            row++;
+        }
+    }
+    ut_assert(ut_number_equals(5, row));
+
+    csv_line_close_file(&csv);
+    csv_line_free(&csv);
+    csv_line_batch_free(&batch);
+}
+
+void test_read_batch() {
+    char *TEST_FILE = "test/test_read_batch.csv";
+    char *TEST_DATA = "ONE,TWO,THREE\n1,2,3\r\n,,\ra,bb,ccc\n4,5,6";
+    size_t ROWS_SIZE[] = {1, 2, 3, 5, 8, 0};
+    create_test_file(TEST_FILE, TEST_DATA);
+
+    for (int i = 0; READ_SIZE[i] != 0; i++) {
+        for (int j = 0; ROWS_SIZE[j] != 0; j++) {
+            assert_file_matches_batch_columns(TEST_FILE, READ_SIZE[i], ROWS_SIZE[j]);
+        }
+    }
+}
+
+void test_read_batch_arena_limit() {
+    char *TEST_FILE = "test/test_read_batch_arena_limit.csv";
+    char *TEST_DATA = "a,b\nc,d\na line that is longer than the arena limit allows\n";
+    create_test_file(TEST_FILE, TEST_DATA);
+
+    arena_s arena;
+    arena_init(&arena, 0, 100);
+
+    csv_line_s csv;
+    csv_line_init(&csv, &arena, ',', 8, 5);
+    csv_line_open_file(&csv, TEST_FILE);
+
+    csv_line_batch_s batch;
+    csv_line_batch_init(&batch, 10, 0);
+
+    ut_assert(ut_number_equals(0, csv_line_read_batch(&csv, &batch)));
+    ut_assert(ut_number_equals(0, batch.fields_count));
+    ut_assert(csv.out_of_memory);
+
+    csv_line_batch_free(&batch);
+    csv_line_close_file(&csv);
+    csv_line_free(&csv);
+    arena_free(&arena);
+}
+
+void test_batch_init_defaults() {
+    csv_line_batch_s batch;
+    csv_line_batch_s *ret = csv_line_batch_init(&batch, 0, 0);
+
+    ut_assert(ret == &batch);
+    ut_assert(batch.rows_size == DEFAULT_BATCH_ROWS_SIZE);
+    ut_assert(batch.fields_size == DEFAULT_BATCH_ROWS_SIZE * DEFAULT_FIELD_SIZE);
+
+    csv_line_batch_free(&batch);
+    ut_assert(ut_is_NULL(batch.rows));
+    ut_assert(ut_is_NULL(batch.offsets));
+    ut_assert(ut_is_NULL(batch.lengths));
+}
+
+void test_read_line_arena() {
+    char *TEST_FILE = "test/test_read_line_arena.csv";
+    char *TEST_DATA = "ONE,TWO,THREE\n1,2,3\n";
+    create_test_file(TEST_FILE, TEST_DATA);
+
+    arena_s arena;
+    arena_init(&arena, 0, 0);
+
+    for (int i = 0; READ_SIZE[i] != 0; i++) {
+        csv_line_s csv;
+        csv_line_init(&csv, &arena, ',', READ_SIZE[i], 5);
+        csv_line_open_file(&csv, TEST_FILE);
+
+        csv_line_read_line(&csv);
+        ASSERT_COLUMNS_EQUAL(3, SIMPLE_COLUMNS[0]);
+        csv_line_read_line(&csv);
+        ASSERT_COLUMNS_EQUAL(3, SIMPLE_COLUMNS[1]);
+
+        csv_line_close_file(&csv);
+        csv_line_free(&csv);
+    }
+    ut_assert(arena.block_recycles > 0);
+    ut_assert(ut_is_NULL(arena.blocks));
+
+    arena_free(&arena);
+    ut_assert(ut_number_equals(0, arena.bytes));
+}
+
+void test_read_line_arena_limit() {
+    char *TEST_FILE = "test/test_read_line_arena_limit.csv";
+    char *TEST_DATA = "a line that is longer than the arena limit allows";
+    create_test_file(TEST_FILE, TEST_DATA);
+
+    arena_s arena;
+    arena_init(&arena, 0, 100);
+
+    csv_line_s csv;
+    csv_line_init(&csv, &arena, ',', 8, 5);
+    csv_line_open_file(&csv, TEST_FILE);
+
+    ut_assert(ut_number_equals(0, csv_line_read_line(&csv)));
+    ut_assert(ut_number_equals(0, csv.fields_count));
+    ut_assert(csv.out_of_memory);
+    ut_assert(arena.peak_bytes <= 100);
+    ut_assert(ut_number_equals(0, csv_line_read_line(&csv)));
+
+    csv_line_close_file(&csv);
+    csv_line_free(&csv);
+    arena_free(&arena);
+}
+
 int main(int argc, char **argv) {
     ut_run(test_init_free);
     ut_run(test_init_defaults);
@@ -319,7 +636,13 @@ int main(int argc, char **argv) {
     ut_run(test_read_line_lf);
     ut_run(test_read_line_cr);
     ut_run(test_read_line_cr_lf);
+    ut_run(test_read_line_trailing_separator);
     ut_run(test_read_line_semicolon);
+    ut_run(test_read_line_arena);
+    ut_run(test_read_line_arena_limit);
+    ut_run(test_batch_init_defaults);
+    ut_run(test_read_batch);
+    ut_run(test_read_batch_arena_limit);
     return ut_end();
 }
 
@@ -1,13 +1,19 @@
 #ifndef CSV_LINE_INCLUDED
 #define CSV_LINE_INCLUDED
 #include <stdint.h>
+
+#include "arena.h"
+
 typedef struct {
     char *file_name;
     FILE *file;
+    arena_s *arena;
+    arena_block_s *block;
     uint8_t *buffer;
     size_t size;
     size_t read_size;
     char separator;
+    char out_of_memory;
 
     size_t start;
     size_t next;
@@ -18,9 +24,28 @@ typedef struct {
     size_t fields_count;
 } csv_line_s;
 
-csv_line_s *csv_line_init(csv_line_s *csv, char separator, size_t read_size, size_t fields_size);
+typedef struct {
+    uint8_t *data;
+
+    size_t rows_size;
+    size_t rows_count;
+    size_t *rows;
+
+    size_t fields_size;
+    size_t fields_count;
+    size_t *offsets;
+    size_t *lengths;
+} csv_line_batch_s;
+
+csv_line_s *csv_line_init(csv_line_s *csv, arena_s *arena, char separator, size_t read_size, size_t fields_size);
 void csv_line_free(csv_line_s *csv);
+void csv_line_open(csv_line_s *csv, FILE *file);
 void csv_line_open_file(csv_line_s *csv, char *file_name);
+// both reads return 0 and set out_of_memory when the arena limit stops them, no partial row is returned
 size_t csv_line_read_line(csv_line_s *csv);
 
+csv_line_batch_s *csv_line_batch_init(csv_line_batch_s *batch, size_t rows_size, size_t fields_size);
+void csv_line_batch_free(csv_line_batch_s *batch);
+size_t csv_line_read_batch(csv_line_s *csv, csv_line_batch_s *batch);
+
 #endif  // CSV_LINE_INCLUDED
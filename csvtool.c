@@ -1,6 +1,18 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "csvtool.h"
 
 // #define UNIT_TEST 1
 
@@ -10,10 +22,21 @@
 
 void print_usage(FILE *fp) {
     fprintf(fp, "CSVTool V0.1\n\n");
-    fprintf(fp, "usage csvtool [options] [file 1] .. [file n] \n\n");
+    fprintf(fp, "usage csvtool [command] [options] [file 1] .. [file n] \n\n");
+    fprintf(fp, "commands:\n");
+    fprintf(fp, "        top                     print the n largest rows by the key column\n");
+    fprintf(fp, "        tail                    print the last n rows\n");
+    fprintf(fp, "        sample                  print n randomly sampled rows\n");
+    fprintf(fp, "\n");
     fprintf(fp, "options:\n");
     fprintf(fp, "        -                       stop processing arguments, extras are filenames\n");
     fprintf(fp, "        -d, --delimiter <char>  the delimiter to use (default ,)\n");
+    fprintf(fp, "        -m, --memory-limit <n>  cap the working memory to n bytes, K/M/G suffixes allowed\n");
+    fprintf(fp, "        -s, --stats             print allocation statistics and peak RSS to stderr\n");
+    fprintf(fp, "        -n, --count <n>         number of rows for top, tail and sample (default 10)\n");
+    fprintf(fp, "        -k, --key <column>      key column for top, a 1 based number or a header name\n");
+    fprintf(fp, "        -t, --threads <n>       threads used by sample (default number of cpus)\n");
+    fprintf(fp, "            --seed <n>          random seed for sample, equal seed and threads repeat the sample\n");
     fprintf(fp, "\n");
 }
 
@@ -26,9 +49,31 @@ char *get_arg_value(char *name, int arg, int argc, char **argv) {
     return argv[arg];
 }
 
+typedef enum {
+    COMMAND_CAT,
+    COMMAND_TOP,
+    COMMAND_TAIL,
+    COMMAND_SAMPLE,
+} command_e;
+
+#define TAIL_BLOCK_SIZE (64 * 1024)
+
+command_e command = COMMAND_CAT;
 char delimiter = ',';
 char use_stdin = 0;
+char print_stats = 0;
 size_t minimum_read_size = 4096;
+size_t minimum_chunk_size = 1024 * 1024;
+size_t memory_limit = 0;
+size_t count = 10;
+char *top_key = NULL;
+size_t threads = 0;
+uint64_t random_state = 0;
+char seed_set = 0;
+uint64_t seed = 0;
+
+arena_s arena;
+arena_block_s *buffer_block = NULL;
 
 char **input_files = NULL;
 size_t input_files_count = 0;
@@ -47,17 +92,75 @@ char eof = 0;
         exit(9);                                                        \
     }
 
+#define EXIT_IF_NO_MEMORY(ptr, what) EXIT_IF((ptr) == NULL, "could not allocate memory for %s%s", what, memory_limit_note())
+
+// names the limit only when one was given, otherwise the system ran out of memory
+char *memory_limit_note() {
+    static char note[64];
+    if (memory_limit == 0) {
+        return "";
+    }
+    snprintf(note, sizeof(note), ", memory limit of %zu bytes reached", memory_limit);
+    return note;
+}
+
+size_t parse_number(char *value) {
+    char *end;
+    EXIT_IF(*value < '0' || *value > '9', "'%s' is not a number", value);
+    errno = 0;
+    size_t number = strtoull(value, &end, 10);
+    EXIT_IF(*end != 0, "'%s' is not a number", value);
+    EXIT_IF(errno == ERANGE, "'%s' is out of range", value);
+    return number;
+}
+
+size_t parse_size(char *value) {
+    char *unit;
+    EXIT_IF(*value < '0' || *value > '9', "'%s' is not a size", value);
+    errno = 0;
+    size_t size = strtoull(value, &unit, 10);
+    EXIT_IF(errno == ERANGE, "'%s' is out of range", value);
+    size_t scale = 1;
+    switch (*unit) {
+        case 'G':
+        case 'g':
+            scale *= 1024;
+            /* fallthrough */
+        case 'M':
+        case 'm':
+            scale *= 1024;
+            /* fallthrough */
+        case 'K':
+        case 'k':
+            scale *= 1024;
+            unit++;
+            break;
+    }
+    EXIT_IF(*unit != 0, "unknown size suffix in '%s', use K, M or G", value);
+    EXIT_IF(size > SIZE_MAX / scale, "'%s' is out of range", value);
+    return size * scale;
+}
+
+void get_buffer(size_t size) {
+    arena_block_release(&arena, buffer_block);
+    buffer_block = arena_block_get(&arena, size + 1);
+    EXIT_IF_NO_MEMORY(buffer_block, "buffer");
+    buffer = (char *)buffer_block->data;
+    buffer_size = buffer_block->size - 1;
+}
+
 void fill_buffer(FILE *fp, char **current, char **line) {
     int line_len = (*current - *line);
     int space_left = buffer_size - line_len;
-    if (space_left) {
+    if (space_left < minimum_read_size) {
+        arena_block_s *old_block = buffer_block;
+        buffer_block = NULL;
+        get_buffer(buffer_size * 2);
         memcpy(buffer, *line, line_len);
-    }
-    if (space_left < minimum_read_size) {  // todo: check alloc error
-        buffer_size *= 2;
-        buffer = realloc(buffer, buffer_size);
-        EXIT_IF(buffer == NULL, "could not allocate memory for buffer");
+        arena_block_release(&arena, old_block);
         space_left = buffer_size - line_len;
+    } else if (space_left) {
+        memmove(buffer, *line, line_len);
     }
     *current = buffer + line_len;
     *line = buffer;
@@ -65,14 +168,19 @@ void fill_buffer(FILE *fp, char **current, char **line) {
 }
 
 void read_line_init(FILE *fp) {
-    buffer_size = minimum_read_size * 2;
-    buffer = (char *)malloc(buffer_size);
-    EXIT_IF(buffer == NULL, "could not allocate memory for buffer");
+    get_buffer(minimum_read_size * 2);
     buffer_pos = buffer;
     int read = fread(buffer, 1, buffer_size, fp);
     buffer_end = buffer + read;
 }
 
+void print_statistics(FILE *fp) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    arena_print_stats(&arena, fp);
+    fprintf(fp, "peak RSS          %ld KB\n", usage.ru_maxrss);
+}
+
 char *read_line(FILE *fp) {
     char *line = buffer_pos;
     char *current = buffer_pos;
@@ -82,20 +190,19 @@ char *read_line(FILE *fp) {
     }
 
     while (1) {
-        while (*current != '\r' && *current != '\n' && current < buffer_end) {
+        while (current < buffer_end && *current != '\r' && *current != '\n') {
             current++;
         }
         if (current < buffer_end) {
+            char cr = *current == '\r';
+            if (cr && current + 1 == buffer_end && !feof(fp)) {
+                current++;
+                fill_buffer(fp, &current, &line);
+                current--;
+            }
             buffer_pos = current + 1;
-            if (*current == '\r') {
-                if (current < buffer_end && *(current + 1) == '\n') {
-                    buffer_pos++;
-                } else {
-                    fill_buffer(fp, &current, &line);
-                    if (*(current + 1) == '\n') {
-                        buffer_pos++;
-                    }
-                }
+            if (cr && buffer_pos < buffer_end && *buffer_pos == '\n') {
+                buffer_pos++;
             }
             *current = 0;
             return line;
@@ -103,6 +210,10 @@ char *read_line(FILE *fp) {
             fill_buffer(fp, &current, &line);
 
             if (current == buffer_end && feof(fp)) {
+                buffer_pos = current;
+                if (current == line) {
+                    return NULL;
+                }
                 *current = 0;
                 return line;
             }
@@ -110,22 +221,605 @@ char *read_line(FILE *fp) {
     }
 }
 
+// slots only grow, so a slot that is overwritten many times costs at most twice its longest row
+void row_slot_store(row_slot_s *slot, char *line, size_t len) {
+    if (len + 1 > slot->capacity) {
+        size_t capacity = slot->capacity == 0 ? 64 : slot->capacity;
+        while (capacity < len + 1) {
+            capacity *= 2;
+        }
+        slot->data = arena_alloc(&arena, capacity);
+        EXIT_IF_NO_MEMORY(slot->data, "row");
+        slot->capacity = capacity;
+    }
+    memcpy(slot->data, line, len);
+    slot->data[len] = 0;
+    slot->len = len;
+}
+
+void write_line(FILE *out, char *line, size_t len) {
+    fwrite(line, len, 1, out);
+    fputc('\n', out);
+}
+
+void *alloc_zeroed(size_t size) {
+    void *ptr = arena_alloc(&arena, size);
+    EXIT_IF_NO_MEMORY(ptr, "row tables");
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+void *alloc_array(size_t elements, size_t element_size) {
+    EXIT_IF(elements > SIZE_MAX / element_size, "could not allocate memory for %zu rows", elements);
+    return alloc_zeroed(elements * element_size);
+}
+
+// doubles an arena array up to limit elements, the old copy stays in the arena so all copies
+// together take at most twice the final size, rows are only held once they arrive
+void *grow_array(void *array, size_t *size, size_t limit, size_t element_size) {
+    size_t grown_size = *size == 0 ? 16 : (*size > limit / 2 ? limit : *size * 2);
+    if (grown_size > limit) {
+        grown_size = limit;
+    }
+    void *grown = alloc_array(grown_size, element_size);
+    if (*size > 0) {
+        memcpy(grown, array, *size * element_size);
+    }
+    *size = grown_size;
+    return grown;
+}
+
+uint64_t random_seed(uint64_t seed) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return z == 0 ? 1 : z;
+}
+
+uint64_t random_next(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// a missing column is the empty string at the end of line, so the key always points into line
+char *get_column(char *line, size_t column, size_t *len) {
+    for (size_t i = 1; i < column; i++) {
+        char *next = strchr(line, delimiter);
+        if (next == NULL) {
+            *len = 0;
+            return line + strlen(line);
+        }
+        line = next + 1;
+    }
+    char *end = strchr(line, delimiter);
+    *len = end == NULL ? strlen(line) : end - line;
+    return line;
+}
+
+typedef struct {
+    char *key;
+    size_t key_len;
+    double number;
+    char numeric;
+    size_t row;
+} top_key_s;
+
+typedef struct {
+    row_slot_s slot;
+    top_key_s key;
+} top_row_s;
+
+top_row_s *top_rows = NULL;
+size_t top_rows_count = 0;
+size_t top_rows_size = 0;
+size_t top_column = 0;
+size_t top_row = 0;
+row_slot_s top_header = {0};
+char top_named_key = 0;
+char top_at_header = 0;
+
+void top_init() {
+    char *end;
+    top_column = strtoull(top_key, &end, 10);
+    top_named_key = *end != 0;
+    if (top_named_key) {
+        top_column = 0;
+    }
+    EXIT_IF(!top_named_key && top_column == 0, "key column '%s' is not a column number, columns start at 1", top_key);
+    top_at_header = top_named_key;
+    top_rows = NULL;
+    top_rows_count = 0;
+    top_rows_size = 0;
+    top_row = 0;
+    top_header = (row_slot_s){0};
+}
+
+void top_get_key(char *line, top_key_s *key) {
+    key->key = get_column(line, top_column, &key->key_len);
+    key->row = top_row++;
+
+    char *end;
+    key->number = strtod(key->key, &end);
+    key->numeric = key->key_len > 0 && end == key->key + key->key_len && key->number == key->number;
+}
+
+// numbers rank above text, equal keys rank earlier rows higher
+int top_compare(top_key_s *a, top_key_s *b) {
+    if (a->numeric != b->numeric) {
+        return a->numeric - b->numeric;
+    }
+    if (a->numeric) {
+        if (a->number != b->number) {
+            return a->number < b->number ? -1 : 1;
+        }
+    } else {
+        int cmp = memcmp(a->key, b->key, a->key_len < b->key_len ? a->key_len : b->key_len);
+        if (cmp != 0) {
+            return cmp;
+        }
+        if (a->key_len != b->key_len) {
+            return a->key_len < b->key_len ? -1 : 1;
+        }
+    }
+    return a->row < b->row ? 1 : (a->row > b->row ? -1 : 0);
+}
+
+int top_compare_descending(const void *a, const void *b) {
+    return top_compare(&((top_row_s *)b)->key, &((top_row_s *)a)->key);
+}
+
+void top_swap(size_t a, size_t b) {
+    top_row_s tmp = top_rows[a];
+    top_rows[a] = top_rows[b];
+    top_rows[b] = tmp;
+}
+
+void top_sift_up(size_t i) {
+    while (i > 0 && top_compare(&top_rows[i].key, &top_rows[(i - 1) / 2].key) < 0) {
+        top_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+void top_sift_down(size_t i) {
+    while (1) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < top_rows_count && top_compare(&top_rows[left].key, &top_rows[smallest].key) < 0) {
+            smallest = left;
+        }
+        if (right < top_rows_count && top_compare(&top_rows[right].key, &top_rows[smallest].key) < 0) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        top_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+void top_store(top_row_s *row, char *line, top_key_s *key) {
+    row_slot_store(&row->slot, line, strlen(line));
+    row->key = *key;
+    row->key.key = row->slot.data + (key->key - line);
+}
+
+void top_resolve_header(char *line) {
+    row_slot_store(&top_header, line, strlen(line));
+    char *column = top_header.data;
+    for (size_t i = 1; column != NULL; i++) {
+        char *end = strchr(column, delimiter);
+        size_t len = end == NULL ? strlen(column) : end - column;
+        if (len == strlen(top_key) && memcmp(column, top_key, len) == 0) {
+            top_column = i;
+            return;
+        }
+        column = end == NULL ? NULL : end + 1;
+    }
+    EXIT_IF(1, "key column '%s' not found in header", top_key);
+}
+
+// every file starts with a header when the key is a column name, only the first one is kept
+void top_file_start() {
+    top_at_header = top_named_key;
+}
+
+// keeps the count largest rows in a min heap, only rows that enter the heap are copied
+void top_add(char *line) {
+    if (top_at_header) {
+        top_at_header = 0;
+        if (top_column == 0) {
+            top_resolve_header(line);
+        }
+        return;
+    }
+    top_key_s key;
+    top_get_key(line, &key);
+    if (top_rows_count < count) {
+        if (top_rows_count == top_rows_size) {
+            top_rows = grow_array(top_rows, &top_rows_size, count, sizeof(top_row_s));
+        }
+        top_store(&top_rows[top_rows_count], line, &key);
+        top_sift_up(top_rows_count++);
+    } else if (count > 0 && top_compare(&key, &top_rows[0].key) > 0) {
+        top_store(&top_rows[0], line, &key);
+        top_sift_down(0);
+    }
+}
+
+void top_print(FILE *out) {
+    if (top_header.len > 0) {
+        write_line(out, top_header.data, top_header.len);
+    }
+    qsort(top_rows, top_rows_count, sizeof(top_row_s), top_compare_descending);
+    for (size_t i = 0; i < top_rows_count; i++) {
+        write_line(out, top_rows[i].slot.data, top_rows[i].slot.len);
+    }
+}
+
+row_slot_s *tail_rows = NULL;
+size_t tail_rows_count = 0;
+size_t tail_rows_size = 0;
+
+void tail_init() {
+    tail_rows = NULL;
+    tail_rows_count = 0;
+    tail_rows_size = 0;
+}
+
+// ring of the last count rows, used when the input can not be read backwards
+void tail_add(char *line) {
+    if (count > 0) {
+        if (tail_rows_count < count && tail_rows_count == tail_rows_size) {
+            tail_rows = grow_array(tail_rows, &tail_rows_size, count, sizeof(row_slot_s));
+        }
+        row_slot_store(&tail_rows[tail_rows_count++ % count], line, strlen(line));
+    }
+}
+
+void tail_print(FILE *out) {
+    size_t first = tail_rows_count > count ? tail_rows_count - count : 0;
+    for (size_t i = first; i < tail_rows_count; i++) {
+        write_line(out, tail_rows[i % count].data, tail_rows[i % count].len);
+    }
+}
+
+// scans backwards from the end of fp and returns the offset of the first of the last count lines
+long tail_start(FILE *fp, size_t count, size_t *found) {
+    *found = 0;
+    if (count == 0 || fseek(fp, 0, SEEK_END) != 0) {
+        return count == 0 ? 0 : -1;
+    }
+    long size = ftell(fp);
+    long pos = size;
+    int next = EOF;
+
+    arena_block_s *block = arena_block_get(&arena, TAIL_BLOCK_SIZE);
+    EXIT_IF_NO_MEMORY(block, "tail");
+    while (pos > 0) {
+        long len = pos < block->size ? pos : block->size;
+        pos -= len;
+        fseek(fp, pos, SEEK_SET);
+        EXIT_IF(fread(block->data, 1, len, fp) != len, "could not read %ld bytes at offset %ld", len, pos);
+        for (long i = len - 1; i >= 0; i--) {
+            int c = block->data[i];
+            if ((c == '\n' || (c == '\r' && next != '\n')) && pos + i + 1 != size) {
+                if (++(*found) == count) {
+                    arena_block_release(&arena, block);
+                    return pos + i + 1;
+                }
+            }
+            next = c;
+        }
+    }
+    arena_block_release(&arena, block);
+    if (size > 0) {
+        (*found)++;
+    }
+    return 0;
+}
+
+// streams every file through the tail ring, used when one of them can not be read backwards
+void tail_stream_files(char **files, size_t files_count, FILE *out) {
+    tail_init();
+    for (size_t i = 0; i < files_count; i++) {
+        FILE *fp = fopen(files[i], "rb");
+        EXIT_IF(fp == NULL, "could not open file '%s' for reading", files[i]);
+        read_line_init(fp);
+        char *line;
+        while ((line = read_line(fp)) != NULL) {
+            tail_add(line);
+        }
+        fclose(fp);
+    }
+    tail_print(out);
+}
+
+void tail_files(char **files, size_t files_count, FILE *out) {
+    for (size_t i = 0; i < files_count; i++) {
+        struct stat st;
+        if (stat(files[i], &st) == 0 && !S_ISREG(st.st_mode)) {
+            tail_stream_files(files, files_count, out);
+            return;
+        }
+    }
+
+    long *starts = alloc_zeroed(files_count * sizeof(long));
+    size_t first = files_count;
+    size_t remaining = count;
+
+    for (size_t i = files_count; i > 0 && remaining > 0; i--) {
+        FILE *fp = fopen(files[i - 1], "rb");
+        EXIT_IF(fp == NULL, "could not open file '%s' for reading", files[i - 1]);
+        size_t found;
+        starts[i - 1] = tail_start(fp, remaining, &found);
+        fclose(fp);
+        if (starts[i - 1] < 0) {
+            tail_stream_files(files, files_count, out);
+            return;
+        }
+        remaining -= found;
+        first = i - 1;
+    }
+
+    for (size_t i = first; i < files_count; i++) {
+        FILE *fp = fopen(files[i], "rb");
+        EXIT_IF(fp == NULL, "could not open file '%s' for reading", files[i]);
+        fseek(fp, starts[i], SEEK_SET);
+        read_line_init(fp);
+        char *line;
+        while ((line = read_line(fp)) != NULL) {
+            write_line(out, line, strlen(line));
+        }
+        fclose(fp);
+    }
+}
+
+sample_chunk_s *sample_chunks = NULL;
+size_t sample_chunks_count = 0;
+size_t sample_chunks_size = 0;
+
+sample_chunk_s *sample_add_chunk(char *data, size_t start, size_t end) {
+    if (sample_chunks_count == sample_chunks_size) {
+        sample_chunks_size = sample_chunks_size == 0 ? 16 : sample_chunks_size * 2;
+        sample_chunks = realloc(sample_chunks, sample_chunks_size * sizeof(sample_chunk_s));
+        EXIT_IF(sample_chunks == NULL, "could not allocate memory for sample chunks");
+    }
+    sample_chunk_s *chunk = &sample_chunks[sample_chunks_count];
+    memset(chunk, 0, sizeof(sample_chunk_s));
+    chunk->data = data;
+    chunk->start = start;
+    chunk->end = end;
+    chunk->index = sample_chunks_count++;
+    chunk->random = random_seed(random_state + chunk->index);
+    if (data != NULL) {
+        // a mapped chunk is sampled on its own thread and can not grow, it holds at most one row per byte
+        chunk->rows_size = end - start + 1 < count ? end - start + 1 : count;
+        chunk->rows = alloc_array(chunk->rows_size, sizeof(sample_row_s));
+    }
+    return chunk;
+}
+
+void sample_init() {
+    sample_chunks_count = 0;
+}
+
+// reservoir sampling, returns the reservoir index the row goes to or -1 if it is skipped
+long sample_reservoir_index(sample_chunk_s *chunk) {
+    size_t row = chunk->rows_seen++;
+    if (row < count) {
+        chunk->rows_count++;
+        return row;
+    }
+    uint64_t index = random_next(&chunk->random) % (row + 1);
+    return index < count ? index : -1;
+}
+
+// streamed rows are copied into a chunk of their own, consecutive streams share it
+void sample_add(char *line) {
+    if (sample_chunks_count == 0 || sample_chunks[sample_chunks_count - 1].data != NULL) {
+        sample_add_chunk(NULL, 0, 0);
+    }
+    sample_chunk_s *chunk = &sample_chunks[sample_chunks_count - 1];
+    if (chunk->rows_seen < count && chunk->rows_seen == chunk->rows_size) {
+        size_t slots_size = chunk->rows_size;
+        chunk->slots = grow_array(chunk->slots, &slots_size, count, sizeof(row_slot_s));
+        chunk->rows = grow_array(chunk->rows, &chunk->rows_size, count, sizeof(sample_row_s));
+    }
+    size_t row = chunk->rows_seen;
+    long index = sample_reservoir_index(chunk);
+    if (index >= 0) {
+        row_slot_store(&chunk->slots[index], line, strlen(line));
+        chunk->rows[index] = (sample_row_s){chunk->slots[index].data, chunk->slots[index].len, chunk->index, row};
+    }
+}
+
+int is_line_start(char *data, size_t size, size_t pos) {
+    return pos == 0 || data[pos - 1] == '\n' || (data[pos - 1] == '\r' && (pos == size || data[pos] != '\n'));
+}
+
+void *sample_chunk(void *arg) {
+    sample_chunk_s *chunk = arg;
+    char *data = chunk->data;
+    size_t pos = chunk->start;
+
+    while (pos < chunk->end) {
+        size_t end = pos;
+        while (end < chunk->end && data[end] != '\r' && data[end] != '\n') {
+            end++;
+        }
+        size_t row = chunk->rows_seen;
+        long index = sample_reservoir_index(chunk);
+        if (index >= 0) {
+            chunk->rows[index] = (sample_row_s){&data[pos], end - pos, chunk->index, row};
+        }
+        pos = end + 1;
+        if (end < chunk->end && data[end] == '\r' && pos < chunk->end && data[pos] == '\n') {
+            pos++;
+        }
+    }
+    return NULL;
+}
+
+// splits data at line starts into up to threads chunks of at least minimum_chunk_size, returns the first chunk index
+size_t sample_split(char *data, size_t size) {
+    size_t first = sample_chunks_count;
+    size_t chunks = size / minimum_chunk_size + 1;
+    if (chunks > threads) {
+        chunks = threads;
+    }
+    size_t start = 0;
+    for (size_t c = 1; c <= chunks; c++) {
+        size_t end = c == chunks ? size : size / chunks * c;
+        while (end < size && !is_line_start(data, size, end)) {
+            end++;
+        }
+        sample_add_chunk(data, start, end);
+        start = end;
+    }
+    return first;
+}
+
+void sample_stream(int fd, char *file_name) {
+    FILE *fp = fdopen(fd, "rb");
+    EXIT_IF(fp == NULL, "could not open file '%s' for reading", file_name);
+    read_line_init(fp);
+    char *line;
+    while ((line = read_line(fp)) != NULL) {
+        sample_add(line);
+    }
+    fclose(fp);
+}
+
+// maps every file and samples its chunks in parallel, files that can not be mapped are streamed
+void sample_files(char **files, size_t files_count) {
+    for (size_t i = 0; i < files_count; i++) {
+        int fd = open(files[i], O_RDONLY);
+        EXIT_IF(fd < 0, "could not open file '%s' for reading", files[i]);
+        struct stat st;
+        EXIT_IF(fstat(fd, &st) != 0, "could not stat file '%s'", files[i]);
+        if (!S_ISREG(st.st_mode)) {
+            sample_stream(fd, files[i]);
+            continue;
+        }
+        size_t size = st.st_size;
+        if (size == 0) {
+            close(fd);
+            continue;
+        }
+        char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            sample_stream(fd, files[i]);
+            continue;
+        }
+        madvise(data, size, MADV_SEQUENTIAL);
+        close(fd);
+
+        size_t first = sample_split(data, size);
+        sample_chunks[first].mapped = size;
+    }
+
+    pthread_t *ids = alloc_array(threads < sample_chunks_count ? threads : sample_chunks_count, sizeof(pthread_t));
+    for (size_t i = 0; i < sample_chunks_count; i += threads) {
+        size_t running = sample_chunks_count - i < threads ? sample_chunks_count - i : threads;
+        for (size_t t = 0; t < running; t++) {
+            EXIT_IF(pthread_create(&ids[t], NULL, sample_chunk, &sample_chunks[i + t]) != 0, "could not start sample thread");
+        }
+        for (size_t t = 0; t < running; t++) {
+            pthread_join(ids[t], NULL);
+        }
+    }
+}
+
+int sample_compare_position(const void *a, const void *b) {
+    const sample_row_s *ra = a;
+    const sample_row_s *rb = b;
+    if (ra->chunk != rb->chunk) {
+        return ra->chunk < rb->chunk ? -1 : 1;
+    }
+    return ra->row < rb->row ? -1 : (ra->row > rb->row ? 1 : 0);
+}
+
+// merges the chunk reservoirs, each pick takes a chunk with probability of its remaining rows
+void sample_print(FILE *out) {
+    size_t total = 0;
+    for (size_t c = 0; c < sample_chunks_count; c++) {
+        total += sample_chunks[c].rows_seen;
+    }
+    size_t selected_count = total < count ? total : count;
+    sample_row_s *selected = alloc_array(selected_count, sizeof(sample_row_s));
+
+    for (size_t i = 0; i < selected_count; i++) {
+        uint64_t pick = random_next(&random_state) % total;
+        sample_chunk_s *chunk = sample_chunks;
+        while (pick >= chunk->rows_seen) {
+            pick -= chunk->rows_seen;
+            chunk++;
+        }
+        size_t index = random_next(&random_state) % chunk->rows_count;
+        selected[i] = chunk->rows[index];
+        chunk->rows[index] = chunk->rows[--chunk->rows_count];
+        chunk->rows_seen--;
+        total--;
+    }
+
+    qsort(selected, selected_count, sizeof(sample_row_s), sample_compare_position);
+    for (size_t i = 0; i < selected_count; i++) {
+        write_line(out, selected[i].line, selected[i].len);
+    }
+}
+
+void sample_free() {
+    for (size_t c = 0; c < sample_chunks_count; c++) {
+        if (sample_chunks[c].mapped) {
+            munmap(sample_chunks[c].data, sample_chunks[c].mapped);
+        }
+    }
+    free(sample_chunks);
+    sample_chunks = NULL;
+    sample_chunks_count = 0;
+    sample_chunks_size = 0;
+}
+
 void process(FILE *fp) {
     char *line;
-    int i = 0;
     while ((line = read_line(fp)) != NULL) {
-        fwrite(line, strlen(line), 1, stdout);
-        fputc('\n', stdout);
+        switch (command) {
+            case COMMAND_TOP:
+                top_add(line);
+                break;
+            case COMMAND_TAIL:
+                tail_add(line);
+                break;
+            case COMMAND_SAMPLE:
+                sample_add(line);
+                break;
+            default:
+                write_line(stdout, line, strlen(line));
+        }
     }
 }
 
-#ifndef UNIT_TEST
+#if !defined(UNIT_TEST) && !defined(CSVTOOL_LIBRARY)
 int main(int argc, char **argv) {
     for (int i = 1; i < argc && input_files == NULL; i++) {
-        if (argv[i][0] != '-') {
+        if (i == 1 && ARG_EQUALS("top")) {
+            command = COMMAND_TOP;
+        } else if (i == 1 && ARG_EQUALS("tail")) {
+            command = COMMAND_TAIL;
+        } else if (i == 1 && ARG_EQUALS("sample")) {
+            command = COMMAND_SAMPLE;
+        } else if (argv[i][0] != '-') {
             input_files = &argv[i];
             input_files_count = argc - i;
-        } else if (IS_ARG("-", NOT_SET)) {
+        } else if (ARG_EQUALS("-")) {
             i++;
             if (i < argc) {
                 input_files = &argv[i];
@@ -138,6 +832,19 @@ int main(int argc, char **argv) {
             delimiter = get_arg_value("delimiter", ++i, argc, argv)[0];
         } else if (IS_ARG("-c", "--use_stdin")) {
             use_stdin = 1;
+        } else if (IS_ARG("-m", "--memory-limit")) {
+            memory_limit = parse_size(get_arg_value("memory-limit", ++i, argc, argv));
+        } else if (IS_ARG("-s", "--stats")) {
+            print_stats = 1;
+        } else if (IS_ARG("-n", "--count")) {
+            count = parse_number(get_arg_value("count", ++i, argc, argv));
+        } else if (IS_ARG("-k", "--key")) {
+            top_key = get_arg_value("key", ++i, argc, argv);
+        } else if (IS_ARG("-t", "--threads")) {
+            threads = parse_number(get_arg_value("threads", ++i, argc, argv));
+        } else if (ARG_EQUALS("--seed")) {
+            seed = parse_number(get_arg_value("seed", ++i, argc, argv));
+            seed_set = 1;
         } else {
             print_usage(stderr);
             fprintf(stderr, "Error: unknown argument '%s'\n", argv[i]);
@@ -150,20 +857,60 @@ int main(int argc, char **argv) {
         return (1);
     }
 
+    if (command == COMMAND_TOP && top_key == NULL) {
+        print_usage(stderr);
+        fprintf(stderr, "Error: top needs a key column given with -k/--key\n");
+        return (1);
+    }
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? cpus : 1;
+    }
+    random_state = random_seed(seed_set ? seed : (uint64_t)time(NULL) ^ getpid());
+
+    arena_init(&arena, 0, memory_limit);
+    if (command == COMMAND_TOP) {
+        top_init();
+    } else if (command == COMMAND_TAIL && use_stdin) {
+        tail_init();
+    } else if (command == COMMAND_SAMPLE) {
+        sample_init();
+    }
+
     if (use_stdin) {
         freopen(NULL, "rb", stdin);
+        read_line_init(stdin);
         process(stdin);
+    } else if (command == COMMAND_TAIL) {
+        tail_files(input_files, input_files_count, stdout);
+    } else if (command == COMMAND_SAMPLE) {
+        sample_files(input_files, input_files_count);
     } else {
         for (int i = 0; i < input_files_count; i++) {
             FILE *fp = fopen(input_files[i], "rb");
             EXIT_IF(fp == NULL, "could not open file '%s' for reading", input_files[i]);
-            if (i == 0) {
-                read_line_init(fp);
+            read_line_init(fp);
+            if (command == COMMAND_TOP) {
+                top_file_start();
             }
             process(fp);
             fclose(fp);
         }
     }
+
+    if (command == COMMAND_TOP) {
+        top_print(stdout);
+    } else if (command == COMMAND_TAIL && use_stdin) {
+        tail_print(stdout);
+    } else if (command == COMMAND_SAMPLE) {
+        sample_print(stdout);
+        sample_free();
+    }
+
+    if (print_stats) {
+        print_statistics(stderr);
+    }
+    arena_free(&arena);
     return 0;
 }
 #endif
@@ -198,6 +945,20 @@ void _write_lines_to_file(char *file_name, char *eol, char **lines) {
     fclose(fp);
 }
 
+// writes the lines into a pipe and names it like a <(...) substitution, returns the read end to close
+int _write_lines_to_pipe(char *file_name, char *eol, char **lines) {
+    int fds[2];
+    EXIT_IF(pipe(fds) != 0, "could not create pipe");
+    while (*lines != NULL) {
+        EXIT_IF(write(fds[1], *lines, strlen(*lines)) < 0, "could not write to pipe");
+        EXIT_IF(write(fds[1], eol, strlen(eol)) < 0, "could not write to pipe");
+        lines++;
+    }
+    close(fds[1]);
+    sprintf(file_name, "/dev/fd/%d", fds[0]);
+    return fds[0];
+}
+
 void test_readLine() {
     char *TEST_FILE_NAME = "./test/lineRederTest.txt";
     char *test_lines[] = {"Test", "Test2", "Test3", "much longer line that causes the buffer to grow multiple times", "Test4", NULL};
@@ -207,6 +968,29 @@ void test_readLine() {
     EXIT_IF(fp == NULL, "could not open file '%s'", TEST_FILE_NAME);
 
     minimum_read_size = 2;  // tet extra low to trigger multiple buffer size doublings
+    arena_init(&arena, 0, 0);
+    read_line_init(fp);
+
+    char **line = test_lines;
+    while (*line != NULL) {
+        ut_assert(ut_str_equals(*line, read_line(fp)));
+        line++;
+    }
+    ut_assert(ut_is_NULL(read_line(fp)));
+    fclose(fp);
+    arena_free(&arena);
+}
+
+void test_readLine_cr_lf() {
+    char *TEST_FILE_NAME = "./test/lineRederTestCrLf.txt";
+    char *test_lines[] = {"Test", "Test2", "Test3", "much longer line that causes the buffer to grow multiple times", "Test4", NULL};
+    _write_lines_to_file(TEST_FILE_NAME, "\r\n", test_lines);
+
+    FILE *fp = fopen(TEST_FILE_NAME, "rb");
+    EXIT_IF(fp == NULL, "could not open file '%s'", TEST_FILE_NAME);
+
+    minimum_read_size = 2;
+    arena_init(&arena, 0, 0);
     read_line_init(fp);
 
     char **line = test_lines;
@@ -216,11 +1000,424 @@ void test_readLine() {
     }
     ut_assert(ut_is_NULL(read_line(fp)));
     fclose(fp);
+    arena_free(&arena);
+}
+
+void test_parse_number() {
+    ut_assert(ut_number_equals(0, parse_number("0")));
+    ut_assert(ut_number_equals(42, parse_number("42")));
+    ut_assert(ut_number_equals(18446744073709551615ULL, parse_number("18446744073709551615")));
+}
+
+void test_parse_size() {
+    ut_assert(ut_number_equals(100, parse_size("100")));
+    ut_assert(ut_number_equals(2 * 1024, parse_size("2K")));
+    ut_assert(ut_number_equals(3 * 1024 * 1024, parse_size("3m")));
+    ut_assert(ut_number_equals(1024ULL * 1024 * 1024, parse_size("1G")));
+}
+
+void test_memory_limit_note() {
+    ut_assert(ut_str_equals("", memory_limit_note()));
+    memory_limit = 1024;
+    ut_assert(ut_str_equals(", memory limit of 1024 bytes reached", memory_limit_note()));
+    memory_limit = 0;
+}
+
+void _read_output(FILE *out, char *output, size_t size) {
+    rewind(out);
+    size_t read = fread(output, 1, size - 1, out);
+    output[read] = 0;
+    fclose(out);
+}
+
+void _top_files(char **files, size_t files_count, char *key, size_t rows, char *output, size_t size) {
+    top_key = key;
+    count = rows;
+    arena_init(&arena, 0, 0);
+    top_init();
+
+    for (size_t i = 0; i < files_count; i++) {
+        FILE *fp = fopen(files[i], "rb");
+        EXIT_IF(fp == NULL, "could not open file '%s'", files[i]);
+        read_line_init(fp);
+        top_file_start();
+        process(fp);
+        fclose(fp);
+    }
+
+    FILE *out = tmpfile();
+    top_print(out);
+    _read_output(out, output, size);
+    arena_free(&arena);
+}
+
+void _top_file(char *file_name, char *key, size_t rows, char *output, size_t size) {
+    _top_files(&file_name, 1, key, rows, output, size);
+}
+
+void test_top() {
+    char *TEST_FILE_NAME = "./test/top.csv";
+    char *test_lines[] = {"name,value", "a,5", "b,17", "c,3", "d,17", "e,x", "f,100", "g,-2.5", NULL};
+    _write_lines_to_file(TEST_FILE_NAME, "\n", test_lines);
+    char output[1024];
+    command = COMMAND_TOP;
+
+    _top_file(TEST_FILE_NAME, "value", 3, output, sizeof(output));
+    ut_assert(ut_str_equals("name,value\nf,100\nb,17\nd,17\n", output));
+
+    _top_file(TEST_FILE_NAME, "2", 3, output, sizeof(output));
+    ut_assert(ut_str_equals("f,100\nb,17\nd,17\n", output));
+
+    _top_file(TEST_FILE_NAME, "2", 100, output, sizeof(output));
+    ut_assert(ut_str_equals("f,100\nb,17\nd,17\na,5\nc,3\ng,-2.5\ne,x\nname,value\n", output));
+
+    _top_file(TEST_FILE_NAME, "1", 2, output, sizeof(output));
+    ut_assert(ut_str_equals("name,value\ng,-2.5\n", output));
+
+    _top_file(TEST_FILE_NAME, "3", 2, output, sizeof(output));
+    ut_assert(ut_str_equals("name,value\na,5\n", output));
+
+    command = COMMAND_CAT;
+}
+
+void test_top_huge_count() {
+    char *TEST_FILE_NAME = "./test/top_huge_count.csv";
+    FILE *fp = fopen(TEST_FILE_NAME, "wb");
+    EXIT_IF(fp == NULL, "could not open file '%s'", TEST_FILE_NAME);
+    for (int i = 0; i < 100; i++) {
+        fprintf(fp, "%d\n", i);
+    }
+    fclose(fp);
+    char output[1024];
+    command = COMMAND_TOP;
+
+    _top_file(TEST_FILE_NAME, "1", SIZE_MAX, output, sizeof(output));
+    ut_assert(strncmp(output, "99\n98\n97\n", 9) == 0);
+    ut_assert(ut_number_equals(290, strlen(output)));
+    ut_assert(arena.peak_bytes < 1024 * 1024);
+
+    command = COMMAND_CAT;
+}
+
+void test_get_column() {
+    char line[] = "a,bc,";
+    size_t len;
+
+    ut_assert(get_column(line, 1, &len) == line && len == 1);
+    ut_assert(get_column(line, 2, &len) == line + 2 && len == 2);
+    ut_assert(get_column(line, 3, &len) == line + 5 && len == 0);
+    ut_assert(get_column(line, 4, &len) == line + 5 && len == 0);
+}
+
+void test_top_missing_column() {
+    char *TEST_FILE_NAME = "./test/top_missing.csv";
+    char *test_lines[] = {"a,5", "b", "c,7", "d", NULL};
+    _write_lines_to_file(TEST_FILE_NAME, "\n", test_lines);
+    char output[1024];
+    command = COMMAND_TOP;
+
+    _top_file(TEST_FILE_NAME, "2", 3, output, sizeof(output));
+    ut_assert(ut_str_equals("c,7\na,5\nb\n", output));
+
+    command = COMMAND_CAT;
+}
+
+void test_top_files_skip_headers() {
+    char *TEST_FILE_NAME = "./test/top.csv";
+    char *TEST_FILE_NAME_2 = "./test/top_2.csv";
+    char *test_lines[] = {"name,value", "a,5", "b,17", NULL};
+    char *test_lines_2[] = {"name,value", "c,3", "d,20", NULL};
+    _write_lines_to_file(TEST_FILE_NAME, "\n", test_lines);
+    _write_lines_to_file(TEST_FILE_NAME_2, "\n", test_lines_2);
+    char *files[] = {TEST_FILE_NAME, TEST_FILE_NAME_2};
+    char output[1024];
+    command = COMMAND_TOP;
+
+    _top_files(files, 2, "value", 10, output, sizeof(output));
+    ut_assert(ut_str_equals("name,value\nd,20\nb,17\na,5\nc,3\n", output));
+
+    _top_files(files, 2, "2", 10, output, sizeof(output));
+    ut_assert(ut_str_equals("d,20\nb,17\na,5\nc,3\nname,value\nname,value\n", output));
+
+    command = COMMAND_CAT;
+}
+
+void test_top_replaced_rows_reuse_slots() {
+    char *TEST_FILE_NAME = "./test/top_ascending.csv";
+    FILE *fp = fopen(TEST_FILE_NAME, "wb");
+    EXIT_IF(fp == NULL, "could not open file '%s'", TEST_FILE_NAME);
+    for (int i = 0; i < 10000; i++) {
+        fprintf(fp, "%d\n", i);
+    }
+    fclose(fp);
+    char output[1024];
+    command = COMMAND_TOP;
+
+    _top_file(TEST_FILE_NAME, "1", 3, output, sizeof(output));
+    ut_assert(ut_str_equals("9999\n9998\n9997\n", output));
+    ut_assert(ut_number_equals(1 + 3, arena.allocations));
+
+    command = COMMAND_CAT;
+}
+
+void _tail_files(char **files, size_t files_count, size_t rows, char *output, size_t size) {
+    count = rows;
+    arena_init(&arena, 0, 0);
+    FILE *out = tmpfile();
+    tail_files(files, files_count, out);
+    _read_output(out, output, size);
+    arena_free(&arena);
+}
+
+void test_tail_files() {
+    char *TEST_FILE_NAME = "./test/tail.csv";
+    char *TEST_FILE_NAME_CR_LF = "./test/tail_cr_lf.csv";
+    char *test_lines[] = {"a", "b", "", "c", NULL};
+    _write_lines_to_file(TEST_FILE_NAME, "\n", test_lines);
+    _write_lines_to_file(TEST_FILE_NAME_CR_LF, "\r\n", test_lines);
+    char *files[] = {TEST_FILE_NAME, TEST_FILE_NAME_CR_LF};
+    char output[1024];
+
+    _tail_files(files, 1, 2, output, sizeof(output));
+    ut_assert(ut_str_equals("\nc\n", output));
+
+    _tail_files(files, 1, 10, output, sizeof(output));
+    ut_assert(ut_str_equals("a\nb\n\nc\n", output));
+
+    _tail_files(&files[1], 1, 3, output, sizeof(output));
+    ut_assert(ut_str_equals("b\n\nc\n", output));
+
+    _tail_files(files, 2, 6, output, sizeof(output));
+    ut_assert(ut_str_equals("\nc\na\nb\n\nc\n", output));
+
+    _tail_files(files, 2, 0, output, sizeof(output));
+    ut_assert(ut_str_equals("", output));
+}
+
+void test_tail_files_multiple_blocks() {
+    char *TEST_FILE_NAME = "./test/tail_blocks.csv";
+    FILE *fp = fopen(TEST_FILE_NAME, "wb");
+    EXIT_IF(fp == NULL, "could not open file '%s'", TEST_FILE_NAME);
+    for (int i = 0; i < 100000; i++) {
+        fprintf(fp, "%d\r\n", i);
+    }
+    fprintf(fp, "last");
+    fclose(fp);
+    char output[1024 * 1024];
+
+    _tail_files(&TEST_FILE_NAME, 1, 2, output, sizeof(output));
+    ut_assert(ut_str_equals("99999\nlast\n", output));
+
+    _tail_files(&TEST_FILE_NAME, 1, 30000, output, sizeof(output));
+    size_t lines = 0;
+    for (char *c = output; *c != 0; c++) {
+        lines += *c == '\n';
+    }
+    ut_assert(ut_number_equals(30000, lines));
+    ut_assert(strncmp(output, "70001\n", 6) == 0);
+}
+
+void test_tail_files_pipe() {
+    char *TEST_FILE_NAME = "./test/tail.csv";
+    char *test_lines[] = {"a", "b", "", "c", NULL};
+    char *pipe_lines[] = {"d", "e", NULL};
+    _write_lines_to_file(TEST_FILE_NAME, "\n", test_lines);
+    char pipe_name[32];
+    char *files[] = {TEST_FILE_NAME, pipe_name};
+    char output[1024];
+
+    int fd = _write_lines_to_pipe(pipe_name, "\r\n", pipe_lines);
+    _tail_files(&files[1], 1, 1, output, sizeof(output));
+    ut_assert(ut_str_equals("e\n", output));
+    close(fd);
+
+    fd = _write_lines_to_pipe(pipe_name, "\n", pipe_lines);
+    _tail_files(files, 2, 4, output, sizeof(output));
+    ut_assert(ut_str_equals("\nc\nd\ne\n", output));
+    close(fd);
+}
+
+void test_tail_stream() {
+    count = 3;
+    arena_init(&arena, 0, 0);
+    tail_init();
+    char line[16];
+    for (int i = 0; i < 10; i++) {
+        sprintf(line, "%d", i);
+        tail_add(line);
+    }
+    char output[1024];
+    FILE *out = tmpfile();
+    tail_print(out);
+    _read_output(out, output, sizeof(output));
+    ut_assert(ut_str_equals("7\n8\n9\n", output));
+    arena_free(&arena);
+}
+
+void test_tail_stream_grows() {
+    char line[16];
+    char output[1024];
+    size_t counts[] = {SIZE_MAX, 20};
+    char *expected[] = {"0\n1\n2\n3\n4\n5\n6\n7\n8\n9\n10\n11\n12\n13\n14\n15\n16\n17\n18\n19\n"
+                        "20\n21\n22\n23\n24\n25\n26\n27\n28\n29\n",
+                        "10\n11\n12\n13\n14\n15\n16\n17\n18\n19\n20\n21\n22\n23\n24\n25\n26\n27\n28\n29\n"};
+
+    for (int c = 0; c < 2; c++) {
+        count = counts[c];
+        arena_init(&arena, 0, 0);
+        tail_init();
+        for (int i = 0; i < 30; i++) {
+            sprintf(line, "%d", i);
+            tail_add(line);
+        }
+        FILE *out = tmpfile();
+        tail_print(out);
+        _read_output(out, output, sizeof(output));
+        ut_assert(ut_str_equals(expected[c], output));
+        ut_assert(arena.peak_bytes < 1024 * 1024);
+        arena_free(&arena);
+    }
+}
+
+void _sample_files(char **files, size_t files_count, size_t rows, uint64_t seed, char *output, size_t size) {
+    count = rows;
+    random_state = random_seed(seed);
+    arena_init(&arena, 0, 0);
+    sample_init();
+    sample_files(files, files_count);
+    FILE *out = tmpfile();
+    sample_print(out);
+    sample_free();
+    _read_output(out, output, size);
+    arena_free(&arena);
+}
+
+void _sample_file(char *file_name, size_t rows, uint64_t seed, char *output, size_t size) {
+    _sample_files(&file_name, 1, rows, seed, output, size);
+}
+
+void test_sample_files() {
+    char *TEST_FILE_NAME = "./test/sample.csv";
+    char *test_lines[] = {"0", "1", "2", "3", "4", "5", "6", "7", "8", "9", NULL};
+    _write_lines_to_file(TEST_FILE_NAME, "\r\n", test_lines);
+    char output[1024];
+    minimum_chunk_size = 4;
+    threads = 3;
+
+    _sample_file(TEST_FILE_NAME, 20, 1, output, sizeof(output));
+    ut_assert(ut_str_equals("0\n1\n2\n3\n4\n5\n6\n7\n8\n9\n", output));
+
+    for (uint64_t seed = 0; seed < 100; seed++) {
+        _sample_file(TEST_FILE_NAME, 4, seed, output, sizeof(output));
+        ut_assert(ut_number_equals(8, strlen(output)));
+        for (int i = 2; i < 8; i += 2) {
+            ut_assert(output[i - 2] < output[i]);
+        }
+    }
+}
+
+void test_sample_files_pipe() {
+    char *TEST_FILE_NAME = "./test/sample.csv";
+    char *test_lines[] = {"0", "1", "2", "3", "4", NULL};
+    char *pipe_lines[] = {"5", "6", "7", "8", "9", NULL};
+    _write_lines_to_file(TEST_FILE_NAME, "\n", test_lines);
+    char pipe_name[32];
+    char *files[] = {pipe_name, TEST_FILE_NAME, pipe_name};
+    char output[1024];
+    minimum_chunk_size = 4;
+    threads = 3;
+
+    int fd = _write_lines_to_pipe(pipe_name, "\n", pipe_lines);
+    _sample_files(files, 1, 20, 1, output, sizeof(output));
+    ut_assert(ut_str_equals("5\n6\n7\n8\n9\n", output));
+    close(fd);
+
+    fd = _write_lines_to_pipe(pipe_name, "\r\n", pipe_lines);
+    _sample_files(files, 2, 20, 1, output, sizeof(output));
+    ut_assert(ut_str_equals("5\n6\n7\n8\n9\n0\n1\n2\n3\n4\n", output));
+    close(fd);
+
+    fd = _write_lines_to_pipe(pipe_name, "\n", pipe_lines);
+    _sample_files(files, 2, SIZE_MAX, 1, output, sizeof(output));
+    ut_assert(ut_str_equals("5\n6\n7\n8\n9\n0\n1\n2\n3\n4\n", output));
+    ut_assert(arena.peak_bytes < 1024 * 1024);
+    close(fd);
+
+    for (uint64_t seed = 0; seed < 100; seed++) {
+        fd = _write_lines_to_pipe(pipe_name, "\n", pipe_lines);
+        _sample_files(&files[1], 2, 4, seed, output, sizeof(output));
+        ut_assert(ut_number_equals(8, strlen(output)));
+        for (int i = 2; i < 8; i += 2) {
+            ut_assert(output[i - 2] < output[i]);
+        }
+        close(fd);
+    }
+}
+
+void test_sample_stream_grows() {
+    char line[16];
+    char output[1024];
+    char expected[1024] = "";
+    count = SIZE_MAX;
+    random_state = random_seed(1);
+    arena_init(&arena, 0, 0);
+    sample_init();
+    for (int i = 0; i < 40; i++) {
+        sprintf(line, "%d", i);
+        sample_add(line);
+        strcat(expected, line);
+        strcat(expected, "\n");
+    }
+    FILE *out = tmpfile();
+    sample_print(out);
+    sample_free();
+    _read_output(out, output, sizeof(output));
+    ut_assert(ut_str_equals(expected, output));
+    arena_free(&arena);
+}
+
+void test_sample_uniform() {
+    char *TEST_FILE_NAME = "./test/sample_uniform.csv";
+    char *test_lines[] = {"0", "1", "2", "3", "4", "5", "6", "7", "8", "9", NULL};
+    _write_lines_to_file(TEST_FILE_NAME, "\n", test_lines);
+    char output[1024];
+    size_t histogram[10] = {0};
+    minimum_chunk_size = 4;
+    threads = 4;
+
+    for (uint64_t seed = 0; seed < 5000; seed++) {
+        _sample_file(TEST_FILE_NAME, 2, seed, output, sizeof(output));
+        histogram[output[0] - '0']++;
+        histogram[output[2] - '0']++;
+    }
+    for (int i = 0; i < 10; i++) {
+        ut_message("line %d sampled %zu times", i, histogram[i]);
+        ut_assert(histogram[i] > 850 && histogram[i] < 1150);
+    }
 }
 
 int main(int argc, char **argv) {
     ut_run(test_is_arg);
     ut_run(test_readLine);
+    ut_run(test_readLine_cr_lf);
+    ut_run(test_parse_number);
+    ut_run(test_parse_size);
+    ut_run(test_memory_limit_note);
+    ut_run(test_top);
+    ut_run(test_top_huge_count);
+    ut_run(test_get_column);
+    ut_run(test_top_missing_column);
+    ut_run(test_top_files_skip_headers);
+    ut_run(test_top_replaced_rows_reuse_slots);
+    ut_run(test_tail_files);
+    ut_run(test_tail_files_multiple_blocks);
+    ut_run(test_tail_files_pipe);
+    ut_run(test_tail_stream);
+    ut_run(test_tail_stream_grows);
+    ut_run(test_sample_files);
+    ut_run(test_sample_files_pipe);
+    ut_run(test_sample_stream_grows);
+    ut_run(test_sample_uniform);
 
     return ut_end();
 }
@@ -0,0 +1,53 @@
+#ifndef CSVTOOL_INCLUDED
+#define CSVTOOL_INCLUDED
+#include <stdint.h>
+#include <stdio.h>
+
+#include "arena.h"
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+} row_slot_s;
+
+typedef struct {
+    char *line;
+    size_t len;
+    size_t chunk;
+    size_t row;
+} sample_row_s;
+
+typedef struct {
+    char *data;
+    size_t start;
+    size_t end;
+    size_t mapped;
+
+    size_t index;
+    uint64_t random;
+    size_t rows_seen;
+    size_t rows_count;
+    size_t rows_size;
+    sample_row_s *rows;
+    row_slot_s *slots;
+} sample_chunk_s;
+
+extern arena_s arena;
+extern size_t minimum_read_size;
+extern size_t minimum_chunk_size;
+extern size_t count;
+extern size_t threads;
+
+extern sample_chunk_s *sample_chunks;
+extern size_t sample_chunks_count;
+
+void read_line_init(FILE *fp);
+char *read_line(FILE *fp);
+
+void sample_init();
+size_t sample_split(char *data, size_t size);
+void *sample_chunk(void *arg);
+void sample_free();
+
+#endif  // CSVTOOL_INCLUDED
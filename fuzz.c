@@ -0,0 +1,394 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// #define UNIT_TEST
+// #define FUZZ_LIBFUZZER
+#include "csvline.h"
+#include "csvtool.h"
+
+#define ROW_END SIZE_MAX
+#define MAX_INPUT_SIZE 512
+#define MAX_READ_SIZE 64
+#define MAX_ROWS_SIZE 16
+#define MAX_CHUNKS 8
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} fuzz_output_s;
+
+void fuzz_output_append(fuzz_output_s *out, const void *data, size_t size) {
+    if (out->size + size > out->capacity) {
+        out->capacity = out->capacity == 0 ? 1024 : out->capacity;
+        while (out->size + size > out->capacity) {
+            out->capacity *= 2;
+        }
+        out->data = realloc(out->data, out->capacity);
+        if (out->data == NULL) {
+            fprintf(stderr, "Error: could not allocate memory for fuzz output\n");
+            abort();
+        }
+    }
+    memcpy(&out->data[out->size], data, size);
+    out->size += size;
+}
+
+void fuzz_output_field(fuzz_output_s *out, const uint8_t *data, size_t size) {
+    fuzz_output_append(out, &size, sizeof(size_t));
+    fuzz_output_append(out, data, size);
+}
+
+void fuzz_output_row_end(fuzz_output_s *out) {
+    size_t marker = ROW_END;
+    fuzz_output_append(out, &marker, sizeof(size_t));
+}
+
+// straight forward in memory splitter, the behaviour every parser variant has to match:
+// lines end at \n, \r or \r\n, a separator always starts another field, also right before EOF
+void parse_reference(const uint8_t *data, size_t size, char separator, fuzz_output_s *out) {
+    size_t pos = 0;
+    while (pos < size) {
+        while (1) {
+            size_t end = pos;
+            while (end < size && data[end] != separator && data[end] != '\r' && data[end] != '\n') {
+                end++;
+            }
+            fuzz_output_field(out, &data[pos], end - pos);
+            if (end == size) {
+                pos = size;
+                break;
+            }
+            pos = end + 1;
+            if (data[end] == separator) {
+                continue;
+            }
+            if (data[end] == '\r' && pos < size && data[pos] == '\n') {
+                pos++;
+            }
+            break;
+        }
+        fuzz_output_row_end(out);
+    }
+}
+
+FILE *open_input(const uint8_t *data, size_t size) {
+    FILE *file = size == 0 ? fopen("/dev/null", "rb") : fmemopen((void *)data, size, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error: could not open fuzz input\n");
+        abort();
+    }
+    return file;
+}
+
+void parse_line(const uint8_t *data, size_t size, char separator, size_t read_size, arena_s *arena, fuzz_output_s *out) {
+    csv_line_s csv;
+    csv_line_init(&csv, arena, separator, read_size, 1);
+    csv_line_open(&csv, open_input(data, size));
+
+    while (csv_line_read_line(&csv)) {
+        for (size_t i = 0; i < csv.fields_count; i++) {
+            fuzz_output_field(out, &csv.buffer[csv.start + csv.fields[i]], csv.fields[i + 1] - csv.fields[i] - 1);
+        }
+        fuzz_output_row_end(out);
+    }
+
+    fclose(csv.file);
+    csv_line_free(&csv);
+}
+
+void parse_batch(const uint8_t *data, size_t size, char separator, size_t read_size, size_t rows_size, arena_s *arena, fuzz_output_s *out) {
+    csv_line_s csv;
+    csv_line_init(&csv, arena, separator, read_size, 1);
+    csv_line_open(&csv, open_input(data, size));
+
+    csv_line_batch_s batch;
+    csv_line_batch_init(&batch, rows_size, 1);
+    while (csv_line_read_batch(&csv, &batch)) {
+        for (size_t row = 0; row < batch.rows_count; row++) {
+            for (size_t field = batch.rows[row]; field < batch.rows[row + 1]; field++) {
+                fuzz_output_field(out, &batch.data[batch.offsets[field]], batch.lengths[field]);
+            }
+            fuzz_output_row_end(out);
+        }
+    }
+
+    csv_line_batch_free(&batch);
+    fclose(csv.file);
+    csv_line_free(&csv);
+}
+
+int outputs_equal(char *variant, fuzz_output_s *expected, fuzz_output_s *actual) {
+    if (expected->size == actual->size && (expected->size == 0 || memcmp(expected->data, actual->data, expected->size) == 0)) {
+        return 1;
+    }
+    size_t pos = 0;
+    while (pos < expected->size && pos < actual->size && expected->data[pos] == actual->data[pos]) {
+        pos++;
+    }
+    fprintf(stderr, "\n%s differs from reference at output byte %zu (expected %zu bytes got %zu)\n", variant, pos, expected->size, actual->size);
+    return 0;
+}
+
+// runs every parser variant on data and compares the fields with the reference
+int fuzz_check(const uint8_t *data, size_t size, char separator, size_t read_size, size_t rows_size) {
+    fuzz_output_s expected = {0};
+    fuzz_output_s actual = {0};
+    int ok = 1;
+
+    parse_reference(data, size, separator, &expected);
+
+    parse_line(data, size, separator, read_size, NULL, &actual);
+    ok &= outputs_equal("csv_line_read_line", &expected, &actual);
+
+    arena_s csv_arena;
+    arena_init(&csv_arena, 0, 0);
+    actual.size = 0;
+    parse_line(data, size, separator, read_size, &csv_arena, &actual);
+    ok &= outputs_equal("csv_line_read_line with arena", &expected, &actual);
+
+    actual.size = 0;
+    parse_batch(data, size, separator, read_size, rows_size, &csv_arena, &actual);
+    ok &= outputs_equal("csv_line_read_batch", &expected, &actual);
+    arena_free(&csv_arena);
+
+    if (!ok) {
+        fprintf(stderr, "separator 0x%02x, read_size %zu, rows_size %zu, input %zu bytes:\n", (uint8_t)separator, read_size, rows_size, size);
+        for (size_t i = 0; i < size; i++) {
+            fprintf(stderr, "%02x", data[i]);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    free(expected.data);
+    free(actual.data);
+    return ok;
+}
+
+// the line splitting of parse_reference without fields, what the csvtool line readers have to match
+void parse_reference_lines(const uint8_t *data, size_t size, fuzz_output_s *out) {
+    size_t pos = 0;
+    while (pos < size) {
+        size_t end = pos;
+        while (end < size && data[end] != '\r' && data[end] != '\n') {
+            end++;
+        }
+        fuzz_output_field(out, &data[pos], end - pos);
+        fuzz_output_row_end(out);
+        pos = end + 1;
+        if (end < size && data[end] == '\r' && pos < size && data[pos] == '\n') {
+            pos++;
+        }
+    }
+}
+
+void parse_read_line(const uint8_t *data, size_t size, size_t read_size, fuzz_output_s *out) {
+    minimum_read_size = read_size;
+    FILE *file = open_input(data, size);
+    read_line_init(file);
+
+    char *line;
+    while ((line = read_line(file)) != NULL) {
+        fuzz_output_field(out, (uint8_t *)line, strlen(line));
+        fuzz_output_row_end(out);
+    }
+    fclose(file);
+}
+
+void parse_sample_chunks(const uint8_t *data, size_t size, size_t chunks, fuzz_output_s *out) {
+    count = size + 1;
+    threads = chunks;
+    minimum_chunk_size = 1;
+    sample_init();
+    sample_split((char *)data, size);
+
+    for (size_t c = 0; c < sample_chunks_count; c++) {
+        sample_chunk(&sample_chunks[c]);
+        for (size_t row = 0; row < sample_chunks[c].rows_count; row++) {
+            fuzz_output_field(out, (uint8_t *)sample_chunks[c].rows[row].line, sample_chunks[c].rows[row].len);
+            fuzz_output_row_end(out);
+        }
+    }
+    sample_free();
+}
+
+// runs the csvtool line readers on data and compares the lines with the reference,
+// read_line returns nul terminated lines so nul bytes are replaced with spaces first,
+// the csvtool arena has to be initialised once before
+int fuzz_check_lines(const uint8_t *data, size_t size, size_t read_size, size_t chunks) {
+    fuzz_output_s expected = {0};
+    fuzz_output_s actual = {0};
+    uint8_t *text = malloc(size + 1);
+    int ok = 1;
+
+    for (size_t i = 0; i < size; i++) {
+        text[i] = data[i] == 0 ? ' ' : data[i];
+    }
+    text[size] = 0;
+
+    parse_reference_lines(text, size, &expected);
+
+    parse_read_line(text, size, read_size, &actual);
+    ok &= outputs_equal("csvtool read_line", &expected, &actual);
+
+    actual.size = 0;
+    parse_sample_chunks(text, size, chunks, &actual);
+    ok &= outputs_equal("csvtool sample_chunk", &expected, &actual);
+    arena_reset(&arena);
+
+    if (!ok) {
+        fprintf(stderr, "minimum_read_size %zu, chunks %zu, input %zu bytes:\n", read_size, chunks, size);
+        for (size_t i = 0; i < size; i++) {
+            fprintf(stderr, "%02x", text[i]);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    free(text);
+    free(expected.data);
+    free(actual.data);
+    return ok;
+}
+
+size_t random_input(uint8_t *data) {
+    static const char ALPHABET[] = ",;\t\r\n\r\nab";
+    size_t size = rand() % (MAX_INPUT_SIZE + 1);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = rand() % 4 == 0 ? rand() % 256 : ALPHABET[rand() % (sizeof(ALPHABET) - 1)];
+    }
+    return size;
+}
+
+int fuzz_random(unsigned int seed, size_t iterations) {
+    static const char SEPARATORS[] = ",;\t";
+    uint8_t data[MAX_INPUT_SIZE];
+    srand(seed);
+    for (size_t i = 0; i < iterations; i++) {
+        size_t size = random_input(data);
+        char separator = SEPARATORS[rand() % (sizeof(SEPARATORS) - 1)];
+        size_t read_size = rand() % MAX_READ_SIZE + 1;
+        size_t rows_size = rand() % MAX_ROWS_SIZE + 1;
+        size_t chunks = rand() % MAX_CHUNKS + 1;
+        if (!fuzz_check(data, size, separator, read_size, rows_size) || !fuzz_check_lines(data, size, read_size, chunks)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+#ifdef FUZZ_LIBFUZZER
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+    arena_init(&arena, 0, 0);
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size < 3) {
+        return 0;
+    }
+    char separator = data[0];
+    size_t read_size = data[1] % MAX_READ_SIZE + 1;
+    size_t rows_size = data[2] % MAX_ROWS_SIZE + 1;
+    size_t chunks = data[2] / MAX_ROWS_SIZE % MAX_CHUNKS + 1;
+    if (!fuzz_check(data + 3, size - 3, separator, read_size, rows_size) || !fuzz_check_lines(data + 3, size - 3, read_size, chunks)) {
+        abort();
+    }
+    return 0;
+}
+#endif  // FUZZ_LIBFUZZER
+
+#if !defined(UNIT_TEST) && !defined(FUZZ_LIBFUZZER)
+int main(int argc, char **argv) {
+    size_t iterations = argc > 1 ? strtoull(argv[1], NULL, 10) : 100000;
+    unsigned int seed = argc > 2 ? strtoul(argv[2], NULL, 10) : 1;
+
+    printf("fuzzing %zu inputs with seed %u\n", iterations, seed);
+    arena_init(&arena, 0, 0);
+    int ok = fuzz_random(seed, iterations);
+    arena_free(&arena);
+    if (!ok) {
+        return 1;
+    }
+    printf("all parser variants match the reference\n");
+    return 0;
+}
+#endif
+
+#ifdef UNIT_TEST
+#include "unit_test.h"
+
+#define ASSERT_FUZZ_CHECK(data, separator)                                                      \
+    for (int i = 0; READ_SIZE[i] != 0; i++) {                                                   \
+        ut_assert(fuzz_check((const uint8_t *)data, strlen(data), separator, READ_SIZE[i], 2)); \
+    }
+
+size_t READ_SIZE[] = {1, 2, 3, 5, 8, 13, 21, 1024, 0};
+
+void test_reference() {
+    fuzz_output_s expected = {0};
+    fuzz_output_s actual = {0};
+
+    fuzz_output_field(&expected, (const uint8_t *)"a", 1);
+    fuzz_output_field(&expected, (const uint8_t *)"", 0);
+    fuzz_output_row_end(&expected);
+    fuzz_output_field(&expected, (const uint8_t *)"", 0);
+    fuzz_output_row_end(&expected);
+    fuzz_output_field(&expected, (const uint8_t *)"b", 1);
+    fuzz_output_field(&expected, (const uint8_t *)"", 0);
+    fuzz_output_row_end(&expected);
+
+    parse_reference((const uint8_t *)"a,\r\n\rb,", 7, ',', &actual);
+    ut_assert(outputs_equal("parse_reference", &expected, &actual));
+
+    free(expected.data);
+    free(actual.data);
+}
+
+void test_line_endings() {
+    ASSERT_FUZZ_CHECK("ONE,TWO,THREE\n1,2,3\n", ',');
+    ASSERT_FUZZ_CHECK("ONE,TWO,THREE\r1,2,3\r", ',');
+    ASSERT_FUZZ_CHECK("ONE,TWO,THREE\r\n1,2,3\r\n", ',');
+    ASSERT_FUZZ_CHECK("ONE;TWO;THREE\n1;2;3", ';');
+}
+
+void test_empty_fields() {
+    ASSERT_FUZZ_CHECK("", ',');
+    ASSERT_FUZZ_CHECK("\n\n\r\r\n", ',');
+    ASSERT_FUZZ_CHECK(",,\n,\r\n,", ',');
+    ASSERT_FUZZ_CHECK("a,", ',');
+}
+
+#define ASSERT_FUZZ_CHECK_LINES(data)                                                               \
+    for (int i = 0; READ_SIZE[i] != 0; i++) {                                                       \
+        for (size_t chunks = 1; chunks <= MAX_CHUNKS; chunks++) {                                   \
+            ut_assert(fuzz_check_lines((const uint8_t *)data, strlen(data), READ_SIZE[i], chunks)); \
+        }                                                                                           \
+    }
+
+void test_lines() {
+    ASSERT_FUZZ_CHECK_LINES("");
+    ASSERT_FUZZ_CHECK_LINES("ONE,TWO\n1,2\n");
+    ASSERT_FUZZ_CHECK_LINES("ONE,TWO\r\n1,2\r\n\r\n");
+    ASSERT_FUZZ_CHECK_LINES("\r\r\n\n\r");
+    ASSERT_FUZZ_CHECK_LINES("a\nlonger line without end");
+}
+
+void test_random() {
+    ut_assert(fuzz_random(1, 2000));
+    ut_assert(fuzz_random(42, 2000));
+}
+
+int main(int argc, char **argv) {
+    arena_init(&arena, 0, 0);
+    ut_run(test_reference);
+    ut_run(test_line_endings);
+    ut_run(test_empty_fields);
+    ut_run(test_lines);
+    ut_run(test_random);
+    arena_free(&arena);
+    return ut_end();
+}
+
+#endif  // UNIT_TEST
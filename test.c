@@ -4,11 +4,24 @@
 #include "csvline.h"
 
 int main(int argc, char **argv) {
+    arena_s arena;
+    arena_init(&arena, 0, 0);
+
     csv_line_s csv;
-    csv_line_init(&csv, ',', 4 * 1024 * 1024, 10);
+    csv_line_init(&csv, &arena, ',', 4 * 1024 * 1024, 10);
     csv_line_open_file(&csv, "VTAS_SINGLE_DB.csv");
-    while (csv_line_read_line(&csv)) {
-        fwrite(&csv.buffer[csv.start + csv.fields[0]], 1, strlen(&csv.buffer[csv.start + csv.fields[0]]), stdout);
-        putc('\n', stdout);
+
+    csv_line_batch_s batch;
+    csv_line_batch_init(&batch, 4096, 0);
+    while (csv_line_read_batch(&csv, &batch)) {
+        for (size_t row = 0; row < batch.rows_count; row++) {
+            size_t field = batch.rows[row];
+            fwrite(&batch.data[batch.offsets[field]], 1, batch.lengths[field], stdout);
+            putc('\n', stdout);
+        }
     }
+    csv_line_batch_free(&batch);
+    csv_line_free(&csv);
+    arena_print_stats(&arena, stderr);
+    arena_free(&arena);
 }